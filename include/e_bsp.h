@@ -152,6 +152,9 @@ void ebsp_barrier();
  * This can be used in combination with the function ebsp_set_sync_callback()
  * for the host program to intervene in running programs on the Epiphany using
  * the host processor.
+ *
+ * While waiting for the host, the core sleeps (using the IDLE instruction)
+ * until the host raises the user interrupt `E_USER_INT`.
  */
 void ebsp_host_sync();
 
@@ -339,6 +342,242 @@ void bsp_set_tagsize(int* tag_bytes);
  */
 void bsp_send(int pid, const void* tag, const void* payload, int nbytes);
 
+/**
+ * A function that folds a message payload into an earlier message.
+ * @param accumulated A pointer to the payload of the earlier message
+ * @param payload A pointer to the payload of the new message
+ * @param nbytes The size of both payloads in bytes
+ *
+ * The combiner should combine the data at `payload` into the data at
+ * `accumulated`. The operation should be associative and commutative,
+ * since the order in which messages are combined is not specified.
+ */
+typedef void (*ebsp_combiner)(void* accumulated, const void* payload,
+                              int nbytes);
+
+/**
+ * Attach a combiner to a message tag.
+ * @param tag A pointer to the tag data
+ * @param combiner The combiner to use for messages with this tag, or 0
+ *  to remove a previously attached combiner
+ *
+ * After this call, a bsp_send() with this tag to a processor that
+ * already has a message with the same tag and payload size queued in the
+ * current superstep does not add a new message. Instead, the payload is
+ * folded into the queued message using `combiner`. This reduces the number
+ * of messages and the amount of payload memory used by, for example,
+ * gradient or histogram updates where only the combined value matters.
+ *
+ * The tag is compared using the tag size that is in effect at the time of
+ * this call. At most `MAX_COMBINERS` (4) tags can have a combiner attached,
+ * and the tag size can be at most 8 bytes.
+ *
+ * The combiners ebsp_combine_int_sum(), ebsp_combine_int_min(),
+ * ebsp_combine_int_max(), ebsp_combine_float_sum(), ebsp_combine_float_min()
+ * and ebsp_combine_float_max() are provided. They treat the payload as an
+ * array of `int` or `float`.
+ *
+ * \code{.c}
+ * int tag = 1;
+ * ebsp_set_combiner(&tag, ebsp_combine_int_sum);
+ * for (int i = 0; i < n; i++)
+ *     bsp_send(0, &tag, &counts[i], sizeof(int));
+ * bsp_sync();
+ * // Processor 0 receives a single message per sender,
+ * // containing the sum of its counts
+ * \endcode
+ *
+ * @remarks Messages sent with ebsp_send_up() are never combined.
+ */
+void ebsp_set_combiner(const void* tag, ebsp_combiner combiner);
+
+/** Combiner that adds arrays of `int`. See ebsp_set_combiner(). */
+void ebsp_combine_int_sum(void* accumulated, const void* payload, int nbytes);
+
+/** Combiner that takes the minimum of arrays of `int`. */
+void ebsp_combine_int_min(void* accumulated, const void* payload, int nbytes);
+
+/** Combiner that takes the maximum of arrays of `int`. */
+void ebsp_combine_int_max(void* accumulated, const void* payload, int nbytes);
+
+/** Combiner that adds arrays of `float`. See ebsp_set_combiner(). */
+void ebsp_combine_float_sum(void* accumulated, const void* payload,
+                            int nbytes);
+
+/** Combiner that takes the minimum of arrays of `float`. */
+void ebsp_combine_float_min(void* accumulated, const void* payload,
+                            int nbytes);
+
+/** Combiner that takes the maximum of arrays of `float`. */
+void ebsp_combine_float_max(void* accumulated, const void* payload,
+                            int nbytes);
+
+/**
+ * Broadcast data from one processor to all other processors.
+ * @param data A pointer to the data. On `root` this is the data to send,
+ *  on the other processors it receives the data.
+ * @param nbytes The size of the data in bytes
+ * @param root The pid of the processor that holds the data
+ * @return The number of clockcycles spent in this function
+ *
+ * The data is sent along a binomial tree, so this takes `log(p)` rounds.
+ * This function has to be called by all processors, and acts as a
+ * barrier. It does not use the BSP message queue or bsp_sync(), so
+ * it can be used anywhere in a superstep.
+ *
+ * \code{.c}
+ * float parameters[4];
+ * if (bsp_pid() == 0)
+ *     read_parameters(parameters);
+ * ebsp_broadcast(parameters, sizeof(parameters), 0);
+ * \endcode
+ *
+ * @remarks `data` may be a local or external memory address, and does not
+ *  have to be registered. It may be at a different address on each
+ *  processor.
+ */
+unsigned ebsp_broadcast(void* data, int nbytes, int root);
+
+/**
+ * Combine data of all processors on one processor.
+ * @param src A pointer to the data of this processor
+ * @param dst A pointer to a buffer of `nbytes` bytes that receives the
+ *  result on `root`. It is not used on the other processors.
+ * @param nbytes The size of the data in bytes
+ * @param op The combiner used to combine the data, see ebsp_set_combiner()
+ * @param root The pid of the processor that receives the result
+ * @return The number of clockcycles spent in this function
+ *
+ * The data is combined along a binomial tree, so this takes `log(p)`
+ * rounds. Every processor allocates a scratch buffer of three times
+ * `nbytes` for the duration of the call, in local memory if possible.
+ * This function has to be called by all processors.
+ *
+ * \code{.c}
+ * float sum = local_sum();
+ * float total;
+ * ebsp_reduce(&sum, &total, sizeof(float), ebsp_combine_float_sum, 0);
+ * \endcode
+ *
+ * @remarks The combiner should be associative and commutative.
+ */
+unsigned ebsp_reduce(const void* src, void* dst, int nbytes,
+                     ebsp_combiner op, int root);
+
+/**
+ * Combine data of all processors on all processors.
+ * @param src A pointer to the data of this processor
+ * @param dst A pointer to a buffer of `nbytes` bytes that receives the
+ *  result. This may be equal to `src`.
+ * @param nbytes The size of the data in bytes
+ * @param op The combiner used to combine the data, see ebsp_set_combiner()
+ * @return The number of clockcycles spent in this function
+ *
+ * When the number of processors is a power of two, this uses recursive
+ * doubling which takes `log(p)` rounds. Otherwise it is an ebsp_reduce()
+ * followed by an ebsp_broadcast(). Every processor allocates a scratch
+ * buffer of two times `nbytes` for the duration of the call.
+ * This function has to be called by all processors.
+ *
+ * @remarks The combiner should be associative and commutative.
+ */
+unsigned ebsp_allreduce(const void* src, void* dst, int nbytes,
+                        ebsp_combiner op);
+
+/**
+ * Compute an inclusive prefix combination over the processors.
+ * @param src A pointer to the data of this processor
+ * @param dst A pointer to a buffer of `nbytes` bytes that receives the
+ *  combination of the data of processors `0` up to and including this
+ *  processor. This may be equal to `src`.
+ * @param nbytes The size of the data in bytes
+ * @param op The combiner used to combine the data, see ebsp_set_combiner()
+ * @return The number of clockcycles spent in this function
+ *
+ * This takes `log(p)` rounds. Every processor allocates a scratch
+ * buffer of two times `nbytes` for the duration of the call.
+ * This function has to be called by all processors.
+ *
+ * \code{.c}
+ * // Compute the offset of the local part of an array
+ * int count = local_count();
+ * int offset;
+ * ebsp_scan(&count, &offset, sizeof(int), ebsp_combine_int_sum);
+ * offset -= count;
+ * \endcode
+ *
+ * @remarks The combiner should be associative and commutative.
+ */
+unsigned ebsp_scan(const void* src, void* dst, int nbytes, ebsp_combiner op);
+
+/**
+ * Collect data of all processors on one processor.
+ * @param src A pointer to the data of this processor
+ * @param dst A pointer to a buffer of `nprocs * nbytes` bytes that receives
+ *  the data on `root`, ordered by pid. It is not used on the other
+ *  processors.
+ * @param nbytes The size of the data of a single processor in bytes
+ * @param root The pid of the processor that receives the data
+ * @return The number of clockcycles spent in this function
+ *
+ * Every processor writes its data directly into `dst` on `root`.
+ * This function has to be called by all processors.
+ */
+unsigned ebsp_gather(const void* src, void* dst, int nbytes, int root);
+
+/**
+ * Exchange a distinct block of data between every pair of processors.
+ * @param src A pointer to `nprocs` blocks of `nbytes` bytes. Block `j` is
+ *  sent to processor `j`.
+ * @param dst A pointer to a buffer of `nprocs` blocks of `nbytes` bytes.
+ *  Block `i` receives the data from processor `i`.
+ * @param nbytes The size of a single block in bytes
+ * @return The number of clockcycles spent in this function
+ *
+ * The blocks are written directly into `dst` on the other processors by
+ * the DMA engine, so the amount of data is not limited by the size of the
+ * BSP payload buffer. When the number of processors is a power of two,
+ * processor `s` sends its blocks in the order `s ^ 1`, `s ^ 2`, ...,
+ * `s ^ (nprocs - 1)`, so that the senders are spread over the receivers.
+ * Otherwise processor `s` sends to `s + 1`, `s + 2`, ... (modulo
+ * `nprocs`). The rounds are not synchronized, so a processor may receive
+ * from several processors at once. This function has to be called by all
+ * processors.
+ *
+ * \code{.c}
+ * // Transpose a matrix of p x p blocks of size b x b, where each
+ * // processor holds one row of blocks
+ * ebsp_alltoall(row, column, b * b * sizeof(float));
+ * // Block i of column is block (i, s) of the matrix. Transposing
+ * // each block locally gives block (s, i) of the transposed matrix.
+ * \endcode
+ *
+ * @remarks `src` and `dst` should not overlap, and should be 8-byte aligned
+ *  with `nbytes` a multiple of 8 for the fastest transfers.
+ */
+unsigned ebsp_alltoall(const void* src, void* dst, int nbytes);
+
+/**
+ * Exchange blocks of varying size between every pair of processors.
+ * @param src A pointer to the data to send
+ * @param sendcounts An array of `nprocs` integers. Entry `j` is the number
+ *  of bytes to send to processor `j`.
+ * @param sdispls An array of `nprocs` integers. Entry `j` is the offset in
+ *  bytes in `src` of the data for processor `j`.
+ * @param dst A pointer to the buffer that receives the data
+ * @param rdispls An array of `nprocs` integers. Entry `i` is the offset in
+ *  bytes in `dst` where the data from processor `i` is written.
+ * @return The number of clockcycles spent in this function
+ *
+ * This is the variable-count version of ebsp_alltoall(), as used for example
+ * for the bucket redistribution in sample sort. The processors have to
+ * agree on the number of bytes that are exchanged, so that `dst` is large
+ * enough. This can be done using an ebsp_alltoall() of the send counts.
+ * This function has to be called by all processors.
+ */
+unsigned ebsp_alltoallv(const void* src, const int* sendcounts,
+                        const int* sdispls, void* dst, const int* rdispls);
+
 /**
  * Obtain The number of messages in the queue and the combined size in bytes
  *  of their data
@@ -444,9 +683,36 @@ void ebsp_send_up(const void* tag, const void* payload, int nbytes);
  * operation on the stream.
  * @remarks A call to the function should always match a single call to
  *  `bsp_stream_close`.
+ * @remarks A stream can only be opened by one core at a time, unless it was
+ *  created using `bsp_stream_create_shared`. A shared stream can be opened by
+ *  all cores at once, and every core has its own position in the stream.
+ * @remarks A stream that was closed before continues at the position where
+ *  it was closed, see `bsp_stream_close`. Use `bsp_stream_seek_to` to
+ *  start at the beginning instead. A shared stream always starts at the
+ *  beginning.
  */
 int bsp_stream_open(ebsp_stream* stream, int stream_id);
 
+/**
+ * Open a stream with a given prefetch depth.
+ *
+ * @param stream Pointer to an existing `bsp_stream` struct to hold the stream
+ *  handle.
+ * @param stream_id The index of the stream.
+ * @param depth The number of tokens that are kept in local memory.
+ * @return Maximum token size of the stream, or `0` on error.
+ *
+ * This works like `bsp_stream_open`, which uses a depth of 2. When
+ * `bsp_stream_move_down` is called with `preload` enabled, the stream keeps
+ * up to `depth - 1` tokens on their way to local memory, besides the token
+ * that is given to the user. This helps when the time to process a token is
+ * shorter than the time to transfer one. Every token buffer takes
+ * (maximum token size + 8) bytes of local memory.
+ *
+ * A depth of 1 disables prefetching, and a depth of 2 is double buffering.
+ */
+int bsp_stream_open_prefetch(ebsp_stream* stream, int stream_id, int depth);
+
 /**
  * Wait for pending transfers to complete and close a stream.
  *
@@ -457,6 +723,15 @@ int bsp_stream_open(ebsp_stream* stream, int stream_id);
  *
  * Cleans up the stream, and frees any buffers that may have been used by the
  * stream.
+ *
+ * The position in the stream is stored, so that the next call to
+ * `bsp_stream_open` for this stream, on any core, continues right after
+ * the token that was last moved down or up. Tokens that were preloaded
+ * are not counted as moved down. This can be used to let one core
+ * process the first part of a stream and another core the rest.
+ *
+ * For a stream created using `bsp_stream_create_distributed`, the tokens
+ * that were preloaded are given back, so that other cores claim them.
  */
 void bsp_stream_close(ebsp_stream* stream);
 
@@ -476,15 +751,90 @@ void bsp_stream_close(ebsp_stream* stream);
  * (meaning the last call to that function had `preload` enabled),
  * then calling `ebsp_stream_seek` will discard any token that was
  * preloaded in memory, so the first call to `ebsp_stream_move_down` after this
- * will yield a token from the new position.
+ * will yield a token from the new position. The new position is relative to
+ * the token that was last obtained, regardless of the tokens that were
+ * preloaded.
  *
  * @remarks This function provides a mechanism through which chunks can be
  *  obtained multiple times. It gives you random access in the memory in
  *  the data stream.
- * @remarks This function has `O(delta_tokens)` complexity.
+ * @remarks This function takes constant time for streams created by the host
+ *  with tokens of equal size, and for streams created with
+ *  `bsp_stream_create_indexed`. If tokens of different sizes were moved up
+ *  to a stream without index, it has `O(delta_tokens)` complexity.
+ * @remarks Streams created using `bsp_stream_create_distributed` do not
+ *  support seeking.
  */
 void bsp_stream_seek(ebsp_stream* stream, int delta_tokens);
 
+/**
+ * Move the cursor in the stream to a given token.
+ *
+ * @param stream The handle of the stream
+ * @param token The number of the token, where the first token is `0`.
+ *
+ * The next call to `bsp_stream_move_down` yields token `token`. If it is out
+ * of bounds, the cursor is moved to the start or end of the stream.
+ * Any preloaded tokens are discarded, as in `bsp_stream_seek`, which has the
+ * same complexity.
+ */
+void bsp_stream_seek_to(ebsp_stream* stream, int token);
+
+/**
+ * Get the number of the token that was last obtained from a stream.
+ *
+ * @param stream The handle of the stream
+ * @return The number of the token that was obtained at the last call to
+ *  `bsp_stream_move_down`, where the first token of the stream has number 0,
+ *  or `-1` if no token was obtained yet.
+ *
+ * This is useful for streams created using `bsp_stream_create_distributed`,
+ * where a core does not know in advance which tokens it will receive.
+ * At the end of the stream, the number of tokens in the stream is returned.
+ * After `bsp_stream_move_down_batch`, the number of the first token of the
+ * batch is returned.
+ */
+int bsp_stream_tell(const ebsp_stream* stream);
+
+/**
+ * The highest priority that can be given to a stream with
+ * `bsp_stream_set_priority`.
+ */
+#define EBSP_STREAM_MAX_PRIORITY 2
+
+/**
+ * Set the priority of the transfers of a stream.
+ *
+ * @param stream The handle of the stream
+ * @param priority The priority, from `0` (the default) up to
+ *  `EBSP_STREAM_MAX_PRIORITY`.
+ *
+ * When a core has several streams open, transfers that are waiting for the
+ * DMA engine are ordered by priority: a transfer is started after
+ * the waiting transfers with the same or a higher priority, but before
+ * those with a lower priority. A token that the core is waiting for, because
+ * it was not preloaded, always goes first. Transfers that have started
+ * are not interrupted.
+ *
+ * For example, the prefetches of a stream that is needed in every iteration
+ * can be given a higher priority than the tokens that are moved up to a
+ * stream of results.
+ */
+void bsp_stream_set_priority(ebsp_stream* stream, int priority);
+
+/**
+ * Get the number of clockcycles the core has waited for a stream.
+ *
+ * @param stream The handle of the stream
+ * @return The number of clockcycles since the stream was opened that
+ *  `bsp_stream_move_down` and `bsp_stream_move_up` spent waiting for data
+ *  transfers of this stream.
+ *
+ * This shows which stream limits the speed of a program, and whether its
+ * prefetch depth or priority should be increased.
+ */
+unsigned bsp_stream_stall_cycles(const ebsp_stream* stream);
+
 /**
  * Obtain the next token from a stream.
  *
@@ -500,14 +850,70 @@ void bsp_stream_seek(ebsp_stream* stream, int delta_tokens);
  *
  * @remarks Behaviour is undefined if the stream was not opened using
  * `bsp_stream_open`.
- * @remarks Memory is transferred using the `DMA1` engine.
+ * @remarks Memory is transferred using the DMA engine.
  * @remarks When using double buffering, the BSP system will allocate memory
  *  for the next chunk, and will start writing to it using the DMA engine
  *  while the current chunk is processed. This requires more (local) memory,
- *  but can greatly increase the overall speed.
+ *  but can greatly increase the overall speed. With a stream opened by
+ *  `bsp_stream_open_prefetch`, more than one token can be preloaded.
+ * @remarks For a stream created using `bsp_stream_create_distributed`, every
+ *  preloaded token is claimed by this core. Tokens that are preloaded
+ *  when the stream is closed are given back, and are claimed by the next
+ *  core that moves down a token of the stream. A core that has already
+ *  reached the end of the stream does not see them, so cores that stop
+ *  early should close the stream before the others finish.
  */
 int bsp_stream_move_down(ebsp_stream* stream, void** buffer, int preload);
 
+/**
+ * Obtain several consecutive tokens from a stream at once.
+ *
+ * @param stream The handle of the stream
+ * @param tokens An array of `count` pointers that receive the locations of
+ *  the local copies of the tokens.
+ * @param sizes An array of `count` integers that receive the sizes of the
+ *  tokens in bytes.
+ * @param count The maximum number of tokens to obtain.
+ * @return The number of tokens that were obtained, which is less than
+ *  `count` at the end of the stream, and `0` if the stream has finished or
+ *  an error has occurred. For a stream created using
+ *  `bsp_stream_create_distributed`, a token that another core has given
+ *  back is obtained on its own, so fewer tokens can be returned before the
+ *  end as well.
+ *
+ * The tokens are transferred to local memory using a single DMA transfer,
+ * instead of one transfer for every token. This is faster for streams with
+ * small tokens, where the time of `bsp_stream_move_down` is mostly spent
+ * on overhead.
+ *
+ * The tokens are stored in a buffer of `count` times the maximum token size
+ * (plus 8 bytes per token) that is owned by the stream. They stay valid
+ * until the next call to this function or until the stream is closed.
+ * After the batch, `bsp_stream_move_down` continues with the next token.
+ * Tokens that were preloaded by `bsp_stream_move_down` are discarded, as in
+ * `bsp_stream_seek`.
+ *
+ * For a stream created using `bsp_stream_create_distributed`, the tokens
+ * of the batch are claimed at once. Tokens of such a stream that were
+ * preloaded by `bsp_stream_move_down` are already claimed by this core, so
+ * they are not discarded but returned first, from the buffers of
+ * `bsp_stream_move_down`. These stay valid until the next call to either
+ * function. Streams created using `bsp_stream_create_encoded` are not
+ * supported.
+ *
+ * \code{.c}
+ * void* tokens[8];
+ * int sizes[8];
+ * int n;
+ * while ((n = bsp_stream_move_down_batch(&s, tokens, sizes, 8)) > 0) {
+ *     for (int i = 0; i < n; i++)
+ *         process(tokens[i], sizes[i]);
+ * }
+ * \endcode
+ */
+int bsp_stream_move_down_batch(ebsp_stream* stream, void** tokens, int* sizes,
+                               int count);
+
 /**
  * Write a local token up to a stream.
  *
@@ -552,10 +958,61 @@ int bsp_stream_move_down(ebsp_stream* stream, void** buffer, int preload);
  *
  * @remarks Behaviour is undefined if the stream was not opened using
  * `bsp_stream_open`.
- * @remarks Memory is transferred using the `DMA1` engine.
+ * @remarks Memory is transferred using the DMA engine, on either channel
+ *  as with `EBSP_DMA_ANY` (see `ebsp_dma_push_channel`).
  */
 int bsp_stream_move_up(ebsp_stream* stream, const void* data, int data_size, int wait_for_completion);
 
+/**
+ * Obtain a local buffer for the next token that is moved up to a stream.
+ *
+ * @param stream The handle of the stream
+ * @return A pointer to a buffer of the maximum token size of the stream,
+ *  or `0` if an error has occurred.
+ *
+ * The stream owns a ring of buffers, one for every token in its prefetch
+ * depth (see `bsp_stream_open_prefetch`). This function returns the buffer
+ * whose token was committed longest ago, and only waits if that token is
+ * still being transferred. The token is moved up by filling the buffer and
+ * calling `bsp_stream_commit`, which returns immediately. This way, the core
+ * can construct up to `depth` tokens while earlier tokens are written
+ * to external memory, without managing buffers itself.
+ *
+ * \code{.c}
+ * ebsp_stream s;
+ * bsp_stream_open_prefetch(&s, 0, 4);
+ * while (...) {
+ *     int* token = bsp_stream_acquire(&s);
+ *     for (int i = 0; i < 100; i++)
+ *         token[i] = 5;
+ *     bsp_stream_commit(&s, 100 * sizeof(int));
+ * }
+ * bsp_stream_close(&s); // waits for all tokens
+ * \endcode
+ *
+ * @remarks Tokens that were preloaded by `bsp_stream_move_down` are
+ *  discarded, as in `bsp_stream_seek`.
+ */
+void* bsp_stream_acquire(ebsp_stream* stream);
+
+/**
+ * Move up the token in the buffer obtained by `bsp_stream_acquire`.
+ *
+ * @param stream The handle of the stream
+ * @param data_size The size of the token in bytes
+ * @return Number of bytes written. Zero if an error has occurred.
+ *
+ * The transfer of the token is started, but this function does not wait for
+ * it. The buffer may not be changed after this call. It is reused by a
+ * later call to `bsp_stream_acquire`, after its transfer has finished.
+ * Every commit needs its own call to `bsp_stream_acquire`; a commit without
+ * one is an error.
+ *
+ * @remarks Memory is transferred using the DMA engine, on either channel
+ *  as with `EBSP_DMA_ANY` (see `ebsp_dma_push_channel`).
+ */
+int bsp_stream_commit(ebsp_stream* stream, int data_size);
+
 /**
  * Allocate external memory.
  * @param nbytes The size of the memory block
@@ -615,10 +1072,18 @@ void ebsp_free(void* ptr);
  * Assumes previous task in `desc` is completed (use ebsp_dma_wait())
  *
  * The DMA (`E_DMA_1`) will be started if it was not started yet.
+ * All tasks pushed with this function use the same channel, so they are done
+ * in the order in which they were pushed. Use ebsp_dma_push_channel() to
+ * use the other channel as well.
  * If it was already started, this task will be pushed to a queue so that it
  * will be done some time later. Use ebsp_dma_wait() to wait for the task to
  * complete.
  *
+ * All tasks that are pushed while the DMA engine is busy are chained
+ * together, and are processed by the DMA engine without intervention of
+ * the core. This means a sequence of many small tasks only costs a single
+ * interrupt.
+ *
  * Usage example:
  * \code{.c}
  * int s = bsp_pid();
@@ -659,15 +1124,122 @@ void ebsp_free(void* ptr);
 void ebsp_dma_push(ebsp_dma_handle* desc, void* dst, const void* src,
                    size_t nbytes);
 
+/**
+ * The DMA channel to use for a task pushed with ebsp_dma_push_channel().
+ */
+typedef enum {
+    EBSP_DMA_ANY,      /**< Let the library choose the channel */
+    EBSP_DMA_CHANNEL0, /**< Use `E_DMA_0` */
+    EBSP_DMA_CHANNEL1  /**< Use `E_DMA_1`, the channel of ebsp_dma_push() */
+} ebsp_dma_channel;
+
+/**
+ * Push a new task to a specific DMA channel, or let the library choose one.
+ * @param desc    Handle for the task, see ebsp_dma_push()
+ * @param dst     Destination address
+ * @param src     Source address
+ * @param nbytes  Amount of bytes to be copied
+ * @param channel The channel to use, or `EBSP_DMA_ANY`
+ *
+ * This works like ebsp_dma_push(), but the task can be processed by either
+ * of the two DMA channels. Each channel has its own queue, so tasks on
+ * different channels are processed at the same time and in no particular
+ * order with respect to each other. Tasks on the same channel are still
+ * done in order.
+ *
+ * With `EBSP_DMA_ANY`, transfers that read into local memory
+ * (e.g. from external memory) are given to `E_DMA_1` and transfers that
+ * write to other cores or to external memory are given to `E_DMA_0`.
+ * If that channel is busy while the other one is idle, the idle channel
+ * is used instead.
+ *
+ * The task is waited for with ebsp_dma_wait(), as usual.
+ */
+void ebsp_dma_push_channel(ebsp_dma_handle* desc, void* dst, const void* src,
+                           size_t nbytes, ebsp_dma_channel channel);
+
+/**
+ * A single transfer in a list of DMA tasks, see ebsp_dma_push_list().
+ *
+ * The transfer copies `rows` rows of `nbytes` bytes each. The start of every
+ * row is `src_stride` bytes after the start of the previous row in the
+ * source, and `dst_stride` bytes after it in the destination. If `rows` is
+ * 0 or 1, the strides are not used and a contiguous block is copied.
+ */
+typedef struct {
+    void* dst;         /**< Destination address */
+    const void* src;   /**< Source address */
+    unsigned nbytes;   /**< Amount of bytes per row */
+    unsigned rows;     /**< Amount of rows */
+    int dst_stride;    /**< Distance between rows in the destination */
+    int src_stride;    /**< Distance between rows in the source */
+} ebsp_dma_item;
+
+/**
+ * Push a list of tasks to the DMA engine as a single operation.
+ * @param handles An array of `count` handles, one for every task
+ * @param items   An array of `count` transfers
+ * @param count   The amount of transfers
+ * @param channel The channel to use, see ebsp_dma_push_channel()
+ *
+ * The tasks are chained together and given to one DMA channel at once, so
+ * that the DMA engine processes the whole list without intervention
+ * of the core. Every task can be waited for with its own handle, or all of
+ * them with ebsp_dma_wait_all().
+ *
+ * Transfers with more than one row are done by the DMA engine directly, and
+ * are useful to copy a tile out of a larger matrix. The distance that the
+ * DMA engine moves between rows is a 16-bit number, so
+ * `stride - nbytes` should fit in a signed 16-bit integer.
+ *
+ * Transfers with `nbytes` equal to 0 are finished immediately.
+ */
+void ebsp_dma_push_list(ebsp_dma_handle* handles, const ebsp_dma_item* items,
+                        int count, ebsp_dma_channel channel);
+
 /**
  * Wait for the task to be completed.
  * @param desc Handle for a task. See ebsp_dma_push().
  *
  * This function blocks untill the task in `desc` is completed.
  * Use somewhere after ebsp_dma_push(). See ebsp_dma_push() for example code.
+ * It works for tasks on both DMA channels.
+ *
+ * If the task is the last one that the DMA engine has been given, the core
+ * sleeps until the DMA interrupt instead of polling, which leaves the local
+ * memory free for the DMA engine and for other cores.
  */
 void ebsp_dma_wait(ebsp_dma_handle* desc);
 
+/**
+ * Check if a task is completed, without waiting.
+ * @param desc Handle for a task. See ebsp_dma_push().
+ * @return 1 if the task is completed, 0 otherwise
+ */
+int ebsp_dma_test(ebsp_dma_handle* desc);
+
+/**
+ * Wait for all tasks in an array of handles to be completed.
+ * @param descs An array of `count` handles
+ * @param count The amount of handles
+ *
+ * This is equivalent to calling ebsp_dma_wait() on every handle.
+ */
+void ebsp_dma_wait_all(ebsp_dma_handle* descs, int count);
+
+/**
+ * Wait until at least one task in an array of handles is completed.
+ * @param descs An array of `count` handles
+ * @param count The amount of handles
+ * @return The index of a completed task, or -1 if `count` is 0
+ *
+ * If several tasks are completed, the lowest index is returned. A task
+ * that was completed before stays completed, so it should be removed from
+ * the array before the next call, for example by swapping it with the last
+ * handle and decreasing `count`.
+ */
+int ebsp_dma_wait_any(ebsp_dma_handle* descs, int count);
+
 /**
  * Get a raw remote memory address for a variable that was registered
  * using bsp_push_reg()
@@ -697,8 +1269,15 @@ void* ebsp_get_direct_address(int pid, const void* variable);
  * the optimal 8-byte transfers so it is far from optimal.
  *
  * This function resides in local core memory and does 8-byte transfers
- * when possible, meaning if both `dst` and `src` are 8-byte aligned.
- * In other cases, 4-byte or single byte transfers are used.
+ * when possible, meaning if `dst` and `src` have the same alignment
+ * modulo 8. If they differ, the source is read in whole words that are
+ * shifted into place, so only the first and last few bytes are copied
+ * one at a time.
+ *
+ * Large copies (256 bytes or more) from another core or from external
+ * memory into local memory are done by the DMA engine if one of the DMA
+ * channels is idle, since reading is much faster for the DMA engine than for
+ * the core.
  */
 void ebsp_memcpy(void* dst, const void* src, size_t nbytes);
 
@@ -31,15 +31,47 @@ typedef struct {
     void* dst_addr;
 } __attribute__((aligned(8))) ebsp_dma_handle;
 
+// A local buffer for one token of a stream (see e_bsp_buffer.c)
+typedef struct {
+    ebsp_dma_handle e_dma_desc; // descriptor of the transfer into buffer
+    void* buffer;               // pointer (in e_core_mem) to the chunk
+    void* position;             // position of the chunk in extmem
+    int token;                  // number of the chunk in the stream
+} __attribute__((aligned(8))) ebsp_stream_slot;
+
 typedef struct {
     ebsp_dma_handle e_dma_desc; // descriptor of dma, used as dma_id as well
     void* cursor;               // current position of the stream in extmem
     int id;                     // stream_id of the stream
     void* extmem_start;         // extmem data in e_core address space
     void* extmem_end;           // end of allocated region
-    void* current_buffer;       // pointer (in e_core_mem) to current chunk
-    void* next_buffer;          // pointer (in e_core_mem) to next chunk
+    ebsp_stream_slot* ring;     // ring of token buffers (in e_core_mem)
+    int depth;                  // number of slots in the ring
+    int ring_head;              // slot of the current chunk
+    int ring_count;             // number of chunks prefetched after it
+    int acquired;               // 1 if the slot at ring_head was acquired
+    int position;               // number of the token at the cursor
+    int ntokens;                // number of tokens, -1 if not uniform
+    unsigned* token_index;      // extmem offsets of the tokens, or NULL
+    int raw;                    // 1 if the stream has no headers
+    int shared;                 // 1 if the stream is read-only and shared
+    int* claim;                 // extmem claim counter, or NULL
+    int* requeue;               // extmem tokens given back by cores
+    int* nrequeued;             // extmem number of tokens in requeue
+    int encoding;               // encoding of the tokens in extmem
+    unsigned max_encoded;       // size of the largest encoded token
+    int priority;               // priority of the transfers of the stream
+    unsigned stall_cycles;      // cycles spent waiting for transfers
+    int last_token;             // number of the token last moved down
+    void* batch;                // buffer for bsp_stream_move_down_batch
+    unsigned batch_capacity;    // size of the batch buffer
     unsigned max_chunksize; // maximum size of a token exluding 8 byte header
+    int pipe_end;               // end of a pipe, or 0 if it is not a pipe
+    int pipe_slots;             // number of tokens that fit in the pipe
+    int* pipe_count;            // extmem count of tokens published by us
+    int* pipe_peer;             // extmem count of the other end of the pipe
+    int* pipe_closed;           // extmem flag set by the writer on close
+    unsigned published;         // offset of the end of the published tokens
 } __attribute__((aligned(8))) ebsp_stream;
 
 
@@ -34,6 +34,44 @@ see the files COPYING and COPYING.LESSER. If not, see
 #define EXT_MEM_TEXT __attribute__((section("EBSP_TEXT")))
 #define EXT_MEM_RO __attribute__((section("EBSP_RO")))
 
+// Maximum number of tags that can have a combiner attached
+#define MAX_COMBINERS 4
+// Maximum tag size (in bytes) of tags that have a combiner attached
+#define MAX_COMBINER_TAGSIZE 8
+
+// Addresses with these bits set are not in local memory of this core
+#define local_mask (0xfff00000)
+
+// State of one DMA channel (see e_bsp_dma.c)
+// Number of priorities of DMA transfers, see _dma_enqueue_priority
+#define DMA_PRIORITY_LEVELS 4
+
+typedef struct {
+    // Start and end of chain of DMA descriptors
+    // cur is the first unfinished descriptor of the running batch
+    // batch_last is the last descriptor of the running batch
+    // last is the last descriptor that was pushed
+    e_dma_desc_t* cur;
+    e_dma_desc_t* batch_last;
+    e_dma_desc_t* last;
+
+    // Descriptors that wait for the running batch are ordered by priority.
+    // level_last[i] is the last waiting descriptor with priority i, or 0
+    e_dma_desc_t* level_last[DMA_PRIORITY_LEVELS];
+
+    // Global-space pointer to local DMAxCONFIG and DMAxSTATUS cpu registers
+    unsigned* config;
+    unsigned* status;
+} ebsp_dma_queue;
+
+// Local copy of the descriptor of an opened deprecated stream.
+// These form a linked list, see e_bsp_buffer_deprecated.c
+typedef struct ebsp_loaded_stream {
+    struct ebsp_loaded_stream* next;
+    unsigned id;
+    ebsp_stream_descriptor desc;
+} ebsp_loaded_stream;
+
 // All internal bsp variables for this core
 // 8-bit variables (mutexes) are grouped together
 // to avoid unnecesary padding
@@ -62,6 +100,21 @@ typedef struct {
     uint32_t read_queue_index;
     uint32_t message_index;
 
+    // Number of bsp_sync calls so far
+    uint32_t superstep;
+
+    // Message combiners (see ebsp_set_combiner)
+    // combined_message[i][pid] is 1 + the index into the outgoing queue
+    // of the message that combiner i folds new messages for pid into,
+    // or 0 if there is none. A row is only valid when
+    // combined_superstep[i] equals the current superstep.
+    uint32_t ncombiners;
+    ebsp_combiner combiners[MAX_COMBINERS];
+    uint32_t combiner_tagsize[MAX_COMBINERS];
+    uint32_t combined_superstep[MAX_COMBINERS];
+    uint8_t combiner_tags[MAX_COMBINERS][MAX_COMBINER_TAGSIZE];
+    uint16_t combined_message[MAX_COMBINERS][NPROCS];
+
     // bsp_sync barrier
     volatile e_barrier_t sync_barrier[NPROCS];
     volatile e_barrier_t* sync_barrier_tgt[NPROCS];
@@ -81,20 +134,18 @@ typedef struct {
     // Base address of malloc table for internal malloc
     void* local_malloc_base;
 
-    // Location of local copy of combuf.extmem_in_streams
-    ebsp_stream_descriptor* local_streams;
+    // Descriptors of the currently opened deprecated streams, see
+    // e_bsp_buffer_deprecated.c. Only opened streams are kept in local memory
+    ebsp_loaded_stream* loaded_streams;
 
     unsigned local_nstreams;
 
-    // Start and end of chain of DMA descriptors
-    // cur_dma_desc is updated in the interrupt when the DMA finishes a task
-    // last_dma_desc is updated in ebsp_dma_push
-    e_dma_desc_t* cur_dma_desc;
-    e_dma_desc_t* last_dma_desc;
-
-    // Global-space pointer to local DMA1CONFIG and DMA1STATUS cpu registers
-    unsigned* dma1config;
-    unsigned* dma1status;
+    // Queues of the two DMA channels, index 0 for DMA0 and 1 for DMA1
+    ebsp_dma_queue dma[2];
+
+    // Buffers of the current collective operation, read by other cores
+    void* coll_buffer;
+    void* coll_scratch;
 } ebsp_core_data;
 
 extern ebsp_core_data coredata;
@@ -105,3 +156,41 @@ extern ebsp_core_data coredata;
 
 void _init_local_malloc();
 
+// DMA functions used by streams, see e_bsp_dma.c
+void _prepare_descriptor(e_dma_desc_t* desc, void* dst, const void* src,
+                         size_t nbytes);
+int _dma_select_channel(void* dst, ebsp_dma_channel channel);
+void _dma_enqueue_priority(ebsp_dma_queue* queue, e_dma_desc_t* first,
+                           e_dma_desc_t* last, int priority);
+
+// Reads ctimer0 without resetting it. The timer counts down,
+// so the number of cycles passed is start - end.
+static inline unsigned _read_ctimer0() {
+    unsigned t;
+    __asm__ __volatile__("movfs %0, ctimer0" : "=r"(t));
+    return t;
+}
+
+// Sleeps until an interrupt arrives, see e_bsp_idle.s.
+// Call with interrupts disabled, they are enabled on return.
+void _ebsp_sleep();
+extern char _ebsp_idle_instruction[];
+
+// Used by interrupt handlers that can end a wait in _ebsp_sleep. If the
+// interrupt arrived just before the IDLE instruction, return past it.
+static inline void _skip_idle() {
+    unsigned iret;
+    __asm__ __volatile__("movfs %0, iret" : "=r"(iret));
+    if (iret == (unsigned)_ebsp_idle_instruction)
+        __asm__ __volatile__("movts iret, %0" : : "r"(iret + 2));
+}
+
+// Converts an address on core pid to a global address.
+// Addresses in external memory or other cores are left unchanged.
+static inline void* _to_global_addr(int pid, const void* addr) {
+    unsigned uptr = (unsigned)addr;
+    if ((uptr & 0xfff00000) == 0)
+        uptr |= ((uint32_t)coredata.coreids[pid]) << 20;
+    return (void*)uptr;
+}
+
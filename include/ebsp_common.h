@@ -47,6 +47,18 @@ see the files COPYING and COPYING.LESSER. If not, see
 // See ebsp_data_request::nbytes
 #define DATA_PUT_BIT (1 << 31)
 
+// Encodings of stream tokens, equal to the values of ebsp_encoding
+// in host_bsp.h
+#define ENCODING_NONE 0
+#define ENCODING_DELTA_VARINT 1
+#define ENCODING_RLE 2
+#define ENCODING_BITPACK 3
+
+// The two ends of a pipe, a stream that one core writes and another reads
+#define PIPE_NONE 0
+#define PIPE_WRITE_END 1
+#define PIPE_READ_END 2
+
 // Structures that are shared between ARM and epiphany
 // need to use the same alignment
 // By default, the epiphany compiler will align structs
@@ -104,7 +116,21 @@ typedef struct {
     void* current_buffer;       // pointer (in e_core_mem) to current chunk
     void* next_buffer;          // pointer (in e_core_mem) to next chunk
     int is_down_stream; // is 1 if it is a down-stream, 0 if it is an up-stream
-    int _padding; // make sure struct is 8 byte aligned when packed in arrays
+    int32_t ntokens;    // number of tokens, or -1 if they are not uniform
+    void* token_index;  // extmem array of token offsets, or NULL
+    int32_t raw;        // is 1 if the stream has no headers (fixed token size)
+    int32_t shared;     // is 1 if the stream is read-only and shared by cores
+    int32_t claim;      // next token to be claimed, or -1 if not distributed
+    void* requeue;      // extmem array of claimed tokens given back, or NULL
+    int32_t nrequeued;  // number of tokens in requeue
+    int32_t encoding;   // encoding of the tokens, see ENCODING_NONE
+    int32_t max_encoded; // size of the largest encoded token
+    int32_t position;   // number of the token at the cursor
+    int32_t pipe_end;   // end of a pipe, see PIPE_NONE
+    int32_t pipe_peer;  // stream id of the other end of a pipe
+    int32_t pipe_count; // tokens published by this end of a pipe
+    int32_t pipe_closed; // is 1 if the write end of a pipe is closed
+    uint32_t published; // offset up to which moved up tokens have arrived
 } __attribute__((aligned(8))) ebsp_stream_descriptor;
 
 // ebsp_combuf is a struct for epiphany <-> ARM communication
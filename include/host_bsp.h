@@ -56,6 +56,7 @@ see the files COPYING and COPYING.LESSER. If not, see
 
 #pragma once
 #include <e-hal.h>
+#include <stdio.h>
 #include "host_bsp_deprecated.h"
 
 /**
@@ -82,6 +83,179 @@ int ebsp_write(int pid, void* src, off_t dst, int size);
  */
 int ebsp_read(int pid, off_t src, void* dst, int size);
 
+/**
+ * The way in which the elements of an array are divided over the cores.
+ *
+ * For an array of `n` elements over `p` cores:
+ * - `EBSP_DIST_BLOCK`: core `s` gets a contiguous block of `n / p` elements,
+ *   the first `n % p` cores get one element extra.
+ * - `EBSP_DIST_CYCLIC`: element `i` goes to core `i % p`, at local index
+ *   `i / p`.
+ */
+typedef enum { EBSP_DIST_BLOCK, EBSP_DIST_CYCLIC } ebsp_distribution;
+
+/**
+ * Distribute an array over the local memory of the Epiphany cores.
+ * @param src A pointer to the array
+ * @param count The number of elements in the array
+ * @param elem_size The size of a single element in bytes
+ * @param dist The distribution of the elements over the cores
+ * @param dst The destination address (as seen by the Epiphany core)
+ * @return 1 on success, 0 on failure
+ *
+ * The elements of each core are written contiguously to `dst` on that core
+ * using ebsp_write(). This does not use the message queue, so it is not
+ * limited by its size and the cores do not have to search through the
+ * queue. This function should be called after bsp_begin() and before
+ * ebsp_spmd(). The address of a global array in the Epiphany program
+ * can be obtained with ebsp_get_symbol_address().
+ *
+ * \code{.c}
+ * float data[1024];
+ * // ...
+ * bsp_begin(bsp_nprocs());
+ * // Core s receives elements s, s + 16, s + 32, ... in the
+ * // global array `float input[64]` of the Epiphany program
+ * ebsp_scatter_down(data, 1024, sizeof(float), EBSP_DIST_CYCLIC,
+ *                   ebsp_get_symbol_address("input"));
+ * ebsp_spmd();
+ * \endcode
+ */
+int ebsp_scatter_down(const void* src, int count, int elem_size,
+                      ebsp_distribution dist, off_t dst);
+
+/**
+ * Distribute an array over the cores with an explicit number of elements
+ * per core.
+ * @param src A pointer to the array
+ * @param counts An array with for every core the number of elements it gets.
+ *  Core `s` gets the `counts[s]` elements following those of core `s - 1`.
+ * @param elem_size The size of a single element in bytes
+ * @param dst The destination address (as seen by the Epiphany core)
+ * @return 1 on success, 0 on failure
+ *
+ * See ebsp_scatter_down().
+ */
+int ebsp_scatterv_down(const void* src, const int* counts, int elem_size,
+                       off_t dst);
+
+/**
+ * Distribute an array over external memory, with a separate region for
+ * every core.
+ * @param src A pointer to the array
+ * @param count The number of elements in the array
+ * @param elem_size The size of a single element in bytes
+ * @param dist The distribution of the elements over the cores
+ * @param dst_ptr The address (as seen by the Epiphany core) of a pointer
+ *  variable on the core that receives the location of its region
+ * @return 1 on success, 0 on failure
+ *
+ * This is like ebsp_scatter_down() but for data that does not fit in
+ * local memory. The region of every core is allocated with
+ * `ebsp_ext_malloc` and can be freed by the core using `ebsp_free`.
+ * Cores without elements receive a null pointer.
+ */
+int ebsp_scatter_down_ext(const void* src, int count, int elem_size,
+                          ebsp_distribution dist, off_t dst_ptr);
+
+/**
+ * Collect an array from the local memory of the Epiphany cores.
+ * @param dst A pointer to a buffer that receives the array
+ * @param count The number of elements in the array
+ * @param elem_size The size of a single element in bytes
+ * @param dist The distribution of the elements over the cores
+ * @param src The source address (as seen by the Epiphany core)
+ * @return 1 on success, 0 on failure
+ *
+ * This is the inverse of ebsp_scatter_down(). It should be called
+ * after ebsp_spmd() and before bsp_end().
+ */
+int ebsp_gather_up(void* dst, int count, int elem_size,
+                   ebsp_distribution dist, off_t src);
+
+/**
+ * Collect an array from the cores with an explicit number of elements
+ * per core.
+ * @param dst A pointer to a buffer that receives the array
+ * @param counts An array with for every core the number of elements
+ * @param elem_size The size of a single element in bytes
+ * @param src The source address (as seen by the Epiphany core)
+ * @return 1 on success, 0 on failure
+ *
+ * This is the inverse of ebsp_scatterv_down().
+ */
+int ebsp_gatherv_up(void* dst, const int* counts, int elem_size, off_t src);
+
+/**
+ * Collect an array from the external memory regions of the cores.
+ * @param dst A pointer to a buffer that receives the array
+ * @param count The number of elements in the array
+ * @param elem_size The size of a single element in bytes
+ * @param dist The distribution of the elements over the cores
+ * @param src_ptr The address (as seen by the Epiphany core) of a pointer
+ *  variable on the core that holds the location of its region
+ * @return 1 on success, 0 on failure
+ *
+ * This is the inverse of ebsp_scatter_down_ext(). The regions are
+ * not freed.
+ */
+int ebsp_gather_up_ext(void* dst, int count, int elem_size,
+                       ebsp_distribution dist, off_t src_ptr);
+
+/**
+ * Obtain the address of a global symbol of the Epiphany program.
+ * @param name The name of the symbol
+ * @return The address of the symbol (as seen by the Epiphany core),
+ *  or 0 if there is no such symbol
+ *
+ * The symbol table is read from the Epiphany executable in bsp_init(). Only
+ * symbols with external linkage can be found, so `static` variables
+ * can not be used.
+ */
+off_t ebsp_get_symbol_address(const char* name);
+
+/**
+ * Write data to a global variable of the Epiphany program.
+ * @param pid The pid of the target processor
+ * @param name The name of the variable
+ * @param src A pointer to the source data
+ * @param offset The offset in bytes within the variable
+ * @param size The amount of bytes to be copied
+ * @return 1 on success, 0 on failure
+ *
+ * This writes directly into local memory of the core using ebsp_write(),
+ * so parameters and small inputs can be set without the message queue and
+ * without an extra superstep on the Epiphany cores. The write fails if it
+ * does not fit within the variable.
+ *
+ * This function should be called after bsp_begin() and before ebsp_spmd(),
+ * since bsp_begin() loads the program.
+ *
+ * \code{.c}
+ * // In the Epiphany program: int iterations;
+ * int iterations = 100;
+ * for (int s = 0; s < bsp_nprocs(); s++)
+ *     ebsp_write_symbol(s, "iterations", &iterations, 0, sizeof(int));
+ * \endcode
+ */
+int ebsp_write_symbol(int pid, const char* name, const void* src, int offset,
+                      int size);
+
+/**
+ * Read data from a global variable of the Epiphany program.
+ * @param pid The pid of the source processor
+ * @param name The name of the variable
+ * @param dst A pointer to a buffer receiving the data
+ * @param offset The offset in bytes within the variable
+ * @param size The amount of bytes to be copied
+ * @return 1 on success, 0 on failure
+ *
+ * This is the counterpart of ebsp_write_symbol(), for example to read
+ * results after ebsp_spmd().
+ */
+int ebsp_read_symbol(int pid, const char* name, void* dst, int offset,
+                     int size);
+
 /**
  * Initializes the BSP system.
  * @param e_name A string with the srec binary name of the Epiphany program
@@ -321,3 +495,364 @@ int ebsp_hpmove(void** tag_ptr_buf, void** payload_ptr_buf);
 void* bsp_stream_create(int stream_size, int token_size,
                          const void* initial_data);
 
+/**
+ * Creates a stream with a token index, for fast seeking.
+ *
+ * @param stream_size The total number of bytes of data in the stream.
+ * @param token_size The size in bytes of a single token. Must be at least 16.
+ * @param initial_data (Optional) The data which should be streamed to an
+ * Epiphany core.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * This works like bsp_stream_create(), but also stores the offset of every
+ * token in external memory. Cores that seek in the stream jump to the
+ * target token directly, instead of walking over the tokens in between.
+ * The index is kept up to date when tokens are moved up to the stream, so it
+ * is useful for streams that are written by a core with tokens of different
+ * sizes and then read back.
+ *
+ * Streams created by bsp_stream_create() that contain tokens of equal size
+ * can be seeked in constant time as well, so they do not need an index.
+ * The index takes 4 bytes for every token, or `stream_size / 2` bytes
+ * for streams that are created without `initial_data`.
+ */
+void* bsp_stream_create_indexed(int stream_size, int token_size,
+                                const void* initial_data);
+
+/**
+ * Creates a read-only stream that can be opened by all cores at once.
+ *
+ * @param stream_size The total number of bytes of data in the stream.
+ * @param token_size The size in bytes of a single token.
+ * @param initial_data The data which should be streamed to the Epiphany
+ * cores.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * A stream created by bsp_stream_create() can only be opened by one core
+ * at a time. When all cores need the same data, a shared stream stores it
+ * in external memory once instead of once for every core. Every core that
+ * opens the stream has its own cursor, so the cores can read and seek in
+ * the stream independently. Tokens can not be moved up to a shared stream.
+ */
+void* bsp_stream_create_shared(int stream_size, int token_size,
+                               const void* initial_data);
+
+/**
+ * Creates a read-only stream whose tokens are distributed over the cores.
+ *
+ * @param stream_size The total number of bytes of data in the stream.
+ * @param token_size The size in bytes of a single token.
+ * @param initial_data The data which should be streamed to the Epiphany
+ * cores.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * This works like bsp_stream_create_shared(), but every token is given to
+ * only one of the cores. Each call to `bsp_stream_move_down` on a core
+ * claims the next token that has not been claimed by any core, so cores
+ * that process their tokens faster receive more tokens. This balances the
+ * work when the time to process a token differs between tokens.
+ * A core can find out which token it received with `bsp_stream_tell`.
+ * Tokens that a core has preloaded when it closes the stream are given
+ * back, and are claimed first by the next cores that read the stream.
+ *
+ * The tokens are claimed from the start again at every call to ebsp_spmd().
+ */
+void* bsp_stream_create_distributed(int stream_size, int token_size,
+                                    const void* initial_data);
+
+/**
+ * The encoding of the tokens of a stream created with
+ * bsp_stream_create_encoded().
+ *
+ * All encodings treat a token as an array of 32-bit integers.
+ */
+typedef enum {
+    EBSP_ENCODING_NONE,         /**< Tokens are not encoded */
+    EBSP_ENCODING_DELTA_VARINT, /**< Differences between consecutive integers
+                                     as variable-length integers, for
+                                     example for (sorted) indices */
+    EBSP_ENCODING_RLE,          /**< Runs of equal integers, for example for
+                                     sparse data with many zeros */
+    EBSP_ENCODING_BITPACK       /**< Integers minus the minimum of the token
+                                     with just enough bits, for values in a
+                                     small range */
+} ebsp_encoding;
+
+/**
+ * Creates a stream whose tokens are compressed in external memory.
+ *
+ * @param stream_size The total number of bytes of data in the stream.
+ * @param token_size The size in bytes of a single token. Must be at least 16.
+ * @param initial_data The data which should be streamed to an Epiphany core.
+ * @param encoding The encoding of the tokens.
+ * @return A pointer to a section of external memory storing the encoded
+ * tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * The host encodes every token, and the Epiphany core decodes it when it is
+ * obtained with `bsp_stream_move_down`, which then returns the size of the
+ * decoded token. Less data has to be transferred from external memory, at
+ * the cost of some time on the core to decode the token. The decoding is
+ * done after the transfer of the next token has started, so with preloading
+ * it overlaps with the transfer.
+ *
+ * Both `stream_size` and `token_size` should be a multiple of 4. Encoded
+ * streams can not be used to move up tokens. Seeking is done in constant
+ * time, as for streams created with bsp_stream_create_indexed().
+ */
+void* bsp_stream_create_encoded(int stream_size, int token_size,
+                                const void* initial_data,
+                                ebsp_encoding encoding);
+
+/**
+ * Creates a stream without headers, with tokens of a fixed size.
+ *
+ * @param stream_size The total number of bytes of data in the stream.
+ * @param token_size The size in bytes of a single token.
+ * @param initial_data (Optional) The data which should be streamed to an
+ * Epiphany core.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * The data of a raw stream is stored contiguously, exactly as it is in
+ * `initial_data`. Every token has size `token_size`, except the last one
+ * which can be smaller. Since the cores do not have to read headers from
+ * external memory, tokens can be preloaded as soon as they are requested.
+ *
+ * If `initial_data` points to external memory, for example a pointer
+ * returned by an earlier call to this function, it is used without copying.
+ * If `initial_data` is zero, the returned pointer can be filled directly
+ * as a normal array, before ebsp_spmd() is called. After ebsp_spmd(), the
+ * tokens that were moved up to the stream are in the array as well.
+ *
+ * When a core moves up a token that is smaller than `token_size`, the rest
+ * of its place in the stream is left unchanged. Larger tokens are truncated.
+ */
+void* bsp_stream_create_raw(int stream_size, int token_size,
+                            const void* initial_data);
+
+/**
+ * Creates a pipe, a stream that one core writes while another core reads it.
+ *
+ * @param nslots The number of tokens that fit in the pipe.
+ * @param token_size The maximum size in bytes of a single token.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * This creates two streams. The first is the write end of the pipe, and the
+ * next stream id is the read end. One core opens the write end and moves
+ * up tokens with `bsp_stream_move_up`, while another core opens the read end
+ * and obtains them with `bsp_stream_move_down`, without going through the
+ * host. This makes it possible to chain kernels on different cores.
+ *
+ * The tokens are stored in a ring of `nslots` tokens in external memory.
+ * When the ring is full, the writer waits until the reader has obtained a
+ * token. When the ring is empty, the reader waits until the writer has
+ * moved up a token, or until the writer closes the stream, which marks the
+ * end of the stream. It is not possible to seek in a pipe.
+ */
+void* bsp_stream_create_pipe(int nslots, int token_size);
+
+/**
+ * A function that gives the next token of a stream created with
+ * bsp_stream_create_source().
+ *
+ * The function writes at most `max_size` bytes to `token`, and returns the
+ * size of the token, or zero at the end of the stream.
+ */
+typedef int (*ebsp_stream_source)(void* user_data, void* token, int max_size);
+
+/**
+ * A function that receives a token of a stream created with
+ * bsp_stream_create_sink().
+ */
+typedef void (*ebsp_stream_sink)(void* user_data, const void* token,
+                                 int size);
+
+/**
+ * Creates a stream whose tokens are given by the host while the cores run.
+ *
+ * @param nslots The number of tokens that are kept in external memory.
+ * @param token_size The maximum size in bytes of a single token.
+ * @param source The function that gives the tokens.
+ * @param user_data Passed to `source`.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * The stream is the read end of a pipe (see bsp_stream_create_pipe()) that
+ * is written by the host. Only `nslots` tokens are in external memory at
+ * a time, so the stream can be larger than external memory. While
+ * ebsp_spmd() runs, the host calls `source` to refill every slot that
+ * a core has read. The core obtains the tokens with `bsp_stream_move_down`,
+ * and waits if the host has not yet refilled the next slot.
+ *
+ * The stream uses two stream ids, of which the first is opened by the core.
+ * It is not possible to seek in the stream. Tokens that were not read
+ * during a call to ebsp_spmd() are read in the next call.
+ */
+void* bsp_stream_create_source(int nslots, int token_size,
+                               ebsp_stream_source source, void* user_data);
+
+/**
+ * Creates a stream whose tokens are received by the host while the cores run.
+ *
+ * @param nslots The number of tokens that are kept in external memory.
+ * @param token_size The maximum size in bytes of a single token.
+ * @param sink The function that receives the tokens.
+ * @param user_data Passed to `sink`.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * This works like bsp_stream_create_source(), but the stream is the write
+ * end of a pipe that is read by the host. The core moves up tokens with
+ * `bsp_stream_move_up`, and the host calls `sink` for every token in order,
+ * so that the slot can be reused. All tokens have been received when
+ * ebsp_spmd() returns.
+ */
+void* bsp_stream_create_sink(int nslots, int token_size, ebsp_stream_sink sink,
+                             void* user_data);
+
+/**
+ * Creates a stream that reads its tokens from a file while the cores run.
+ *
+ * @param file The file to read from.
+ * @param nslots The number of tokens that are kept in external memory.
+ * @param token_size The size in bytes of a single token.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * See bsp_stream_create_source(). The file is read from its current
+ * position until its end, in tokens of `token_size` bytes except possibly
+ * the last one. The file is not closed.
+ */
+void* bsp_stream_create_file_source(FILE* file, int nslots, int token_size);
+
+/**
+ * Creates a stream that writes its tokens to a file while the cores run.
+ *
+ * @param file The file to write to.
+ * @param nslots The number of tokens that are kept in external memory.
+ * @param token_size The maximum size in bytes of a single token.
+ * @return A pointer to a section of external memory storing the tokens.
+ *
+ * The function returns NULL on failure.
+ *
+ * See bsp_stream_create_sink(). The tokens are appended to the file one
+ * after another, without their sizes. The file is not closed.
+ */
+void* bsp_stream_create_file_sink(FILE* file, int nslots, int token_size);
+
+/**
+ * A reader of the tokens that are moved up to a stream while the cores run.
+ *
+ * See bsp_stream_reader_open().
+ */
+typedef struct {
+    int id;          /**< The stream id */
+    unsigned offset; /**< The offset of the next token in the stream */
+    char* data;      /**< The data of the stream in external memory */
+} ebsp_stream_reader;
+
+/**
+ * Starts reading the tokens that are moved up to a stream.
+ *
+ * @param reader The reader to initialize.
+ * @param stream A pointer returned by one of the `bsp_stream_create`
+ * functions.
+ * @return 1 on success, 0 if `stream` is not a stream.
+ *
+ * Normally, the tokens that are moved up to a stream can only be used
+ * by the host after ebsp_spmd() has returned. A reader follows the tokens
+ * while the cores are running, for example from a separate thread of the
+ * host program or from the sync callback (see ebsp_set_sync_callback()).
+ * The cores publish how far the data of the stream has arrived in external
+ * memory, so a token is only given to the reader when it is complete.
+ *
+ * The reader reads the stream from the start, so the stream should be
+ * created without initial data and written from start to end. A reader
+ * follows the tokens that are moved up during one call to ebsp_spmd().
+ * Pipes can not be read with a reader.
+ */
+int bsp_stream_reader_open(ebsp_stream_reader* reader, const void* stream);
+
+/**
+ * Obtains the next token from a reader if it is available.
+ *
+ * @param reader The reader.
+ * @param token Receives a pointer to the token in external memory, or NULL.
+ * @return The size of the token, or 0 if there is no new token yet.
+ *
+ * This function does not wait. The token stays valid until the stream
+ * is written again at that position.
+ */
+int bsp_stream_reader_poll(ebsp_stream_reader* reader, void** token);
+
+/**
+ * Obtains the next token from a reader, and waits for it if needed.
+ *
+ * @param reader The reader.
+ * @param token Receives a pointer to the token in external memory, or NULL.
+ * @return The size of the token, or 0 if ebsp_spmd() is not running and
+ * there are no tokens left.
+ *
+ * Since this function waits until a core moves up the next token,
+ * it should be called from a different thread than ebsp_spmd().
+ */
+int bsp_stream_reader_wait(ebsp_stream_reader* reader, void** token);
+
+/**
+ * The order in which the elements of a matrix, or the tiles of a stream
+ * created with bsp_stream_create_tiled(), are stored.
+ */
+typedef enum {
+    EBSP_ROW_MAJOR,   /**< Row by row */
+    EBSP_COLUMN_MAJOR /**< Column by column */
+} ebsp_matrix_order;
+
+/**
+ * Creates a raw stream of the tiles of a matrix.
+ *
+ * @param rows The number of rows of the matrix.
+ * @param cols The number of columns of the matrix.
+ * @param element_size The size in bytes of a single element.
+ * @param matrix The elements of the matrix.
+ * @param layout The order in which the elements of `matrix` are stored.
+ * @param tile_rows The number of rows of a tile.
+ * @param tile_cols The number of columns of a tile.
+ * @param tile_order The order in which the tiles are put in the stream.
+ * @param repeat The number of times the tiles are put in the stream.
+ * @return A pointer to a section of external memory storing the tiles.
+ *
+ * The function returns NULL on failure.
+ *
+ * Every token of the stream is a tile of `tile_rows` by `tile_cols`
+ * elements, stored in the same order as the elements of `matrix`.
+ * With `EBSP_ROW_MAJOR` as `tile_order` the stream contains the tiles of the
+ * first row of tiles, followed by those of the second row of tiles, and so
+ * on. With `EBSP_COLUMN_MAJOR` it goes column of tiles by column of tiles.
+ * Tiles at the border of the matrix that do not fit within the matrix are
+ * padded with zeros, so that all tokens have the same size.
+ *
+ * When `repeat` is larger than one, the sequence of tiles is stored that
+ * many times, so that a core can read the tiles again without seeking back.
+ * This takes `repeat` times as much external memory.
+ *
+ * The stream is created with bsp_stream_create_raw(), so the matrix does
+ * not have to be rearranged by the host, and the returned pointer can be
+ * used as described there.
+ */
+void* bsp_stream_create_tiled(int rows, int cols, int element_size,
+                              const void* matrix, ebsp_matrix_order layout,
+                              int tile_rows, int tile_cols,
+                              ebsp_matrix_order tile_order, int repeat);
+
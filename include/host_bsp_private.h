@@ -30,8 +30,8 @@ see the files COPYING and COPYING.LESSER. If not, see
 #include <time.h>
 
 #define MAX_N_STREAMS 1000
+#define MAX_HOST_STREAMS 32
 
-#ifdef DEBUG
 typedef struct {
     int index;
     unsigned int value; // must be unsigned, addresses use the last bit
@@ -41,7 +41,21 @@ typedef struct {
     int section; // SHN_ABS, SHN_COMMON, SHN_UNDEF, or section index
     char name[64];
 } Symbol;
-#endif
+
+// A stream of which the host serves one end, see host_bsp_buffer.c
+typedef struct {
+    int id;                    // stream id of the end that a core opens
+    int is_source;             // 1 if the host writes the tokens
+    ebsp_stream_source source; // function that gives the tokens, or 0
+    ebsp_stream_sink sink;     // function that receives the tokens, or 0
+    void* user_data;
+    void* ring;    // the slots in external memory (host pointer)
+    int nslots;
+    int slot_size; // size of a slot including its header
+    int token_size;
+    int count;     // number of tokens written or read by the host
+    int done;      // 1 if the source has no tokens left
+} ebsp_host_stream;
 
 /*
  *  Global BSP state
@@ -93,11 +107,19 @@ typedef struct {
     ebsp_stream_descriptor buffered_streams[NPROCS][MAX_N_STREAMS];
     ebsp_stream_descriptor shared_streams[MAX_N_STREAMS];
 
+    // Stream descriptors in external memory during ebsp_spmd (host pointer)
+    ebsp_stream_descriptor* volatile stream_descriptors;
+
+    // 1 while the cores run, read by bsp_stream_reader_wait
+    volatile int spmd_running;
+
+    // Streams that are served by the host while the cores run
+    ebsp_host_stream host_streams[MAX_HOST_STREAMS];
+    int num_host_streams;
 
-#ifdef DEBUG
+    // Global symbols of the Epiphany program
     Symbol* e_symbols;
     int num_symbols;
-#endif
 
 } bsp_state_t;
 
@@ -123,6 +145,21 @@ int ebsp_read(int pid, off_t src, void* dst, int size);
 int _write_core_syncstate(int pid, int syncstate);
 int _write_extmem(void* src, off_t offset, int size);
 
+/*
+ *  host_bsp_scatter
+ */
+int ebsp_scatter_down(const void* src, int count, int elem_size,
+                      ebsp_distribution dist, off_t dst);
+int ebsp_scatterv_down(const void* src, const int* counts, int elem_size,
+                       off_t dst);
+int ebsp_scatter_down_ext(const void* src, int count, int elem_size,
+                          ebsp_distribution dist, off_t dst_ptr);
+int ebsp_gather_up(void* dst, int count, int elem_size,
+                   ebsp_distribution dist, off_t src);
+int ebsp_gatherv_up(void* dst, const int* counts, int elem_size, off_t src);
+int ebsp_gather_up_ext(void* dst, int count, int elem_size,
+                       ebsp_distribution dist, off_t src_ptr);
+
 /*
  *  host_bsp_buffer
  */
@@ -135,6 +172,8 @@ void _ebsp_add_stream(int dst_core_id, void* extmem_in_buffer, int nbytes,
                       int max_chunksize, int is_instream);
 void ebsp_create_down_stream_raw(const void* src, int dst_core_id, int nbytes,
                                  int max_chunksize);
+void _host_streams_service();
+void _host_streams_finish();
 
 /*
  *  host_bsp_mp
@@ -164,8 +203,11 @@ void init_application_path();
 /*
  * host_bsp_debug
  */
-#ifdef DEBUG
 void _read_elf(const char* filename);
 Symbol* _get_symbol_by_addr(void* addr);
 Symbol* _get_symbol_by_name(const char* symbol);
-#endif
+off_t ebsp_get_symbol_address(const char* name);
+int ebsp_write_symbol(int pid, const char* name, const void* src, int offset,
+                      int size);
+int ebsp_read_symbol(int pid, const char* name, void* dst, int offset,
+                     int size);
@@ -30,7 +30,10 @@ ebsp_core_data coredata;
 void _write_syncstate(int8_t state);
 
 void _int_isr();
-void _dma_interrupt();
+void _user_interrupt();
+void _wait_for_continue();
+void _dma0_interrupt();
+void _dma1_interrupt();
 
 void EXT_MEM_TEXT bsp_begin() {
     int row = e_group_config.core_row;
@@ -44,9 +47,13 @@ void EXT_MEM_TEXT bsp_begin() {
     coredata.nprocs = combuf->nprocs;
     coredata.tagsize = combuf->tagsize;
     coredata.tagsize_next = coredata.tagsize;
-    coredata.dma1config =
+    coredata.dma[0].config =
+        e_get_global_address(row, col, (void*)E_REG_DMA0CONFIG);
+    coredata.dma[0].status =
+        e_get_global_address(row, col, (void*)E_REG_DMA0STATUS);
+    coredata.dma[1].config =
         e_get_global_address(row, col, (void*)E_REG_DMA1CONFIG);
-    coredata.dma1status =
+    coredata.dma[1].status =
         e_get_global_address(row, col, (void*)E_REG_DMA1STATUS);
     coredata.local_nstreams = combuf->n_streams[coredata.pid];
 
@@ -74,33 +81,28 @@ void EXT_MEM_TEXT bsp_begin() {
     e_irq_attach(E_TIMER0_INT, _int_isr); // 3
     e_irq_attach(E_TIMER1_INT, _int_isr); // 4
     e_irq_attach(E_MESSAGE_INT, _int_isr); // 5
-    e_irq_attach(E_DMA0_INT, _int_isr); // 6
-    e_irq_attach(E_DMA1_INT, _dma_interrupt); // 7
-    e_irq_attach(E_USER_INT, _int_isr); // 9 (8 is WAND)
-    // Clear the IMASK for all 8 interrupts
+    e_irq_attach(E_DMA0_INT, _dma0_interrupt); // 6
+    e_irq_attach(E_DMA1_INT, _dma1_interrupt); // 7
+    e_irq_attach(E_USER_INT, _user_interrupt); // 9 (8 is WAND)
+    // Clear the IMASK for all 8 interrupts and the user interrupt
     unsigned prev = e_reg_read(E_REG_IMASK);
-    e_reg_write(E_REG_IMASK, prev & 0xffffff00); // clear 0 to 7
+    e_reg_write(E_REG_IMASK, prev & 0xfffffd00); // clear 0 to 7, and 9
 #else
-    // Attach interrupt handler for DMA1
-    e_irq_attach(E_DMA1_INT, _dma_interrupt); // 7
-    // Clear IMASK for DMA1 interrupt
+    // Attach interrupt handlers for DMA0 and DMA1
+    e_irq_attach(E_DMA0_INT, _dma0_interrupt); // 6
+    e_irq_attach(E_DMA1_INT, _dma1_interrupt); // 7
+    // Attach interrupt handler for the host, see _wait_for_continue
+    e_irq_attach(E_USER_INT, _user_interrupt); // 9
+    // Clear IMASK for DMA0, DMA1 and user interrupts
+    e_irq_mask(E_DMA0_INT, E_FALSE);
     e_irq_mask(E_DMA1_INT, E_FALSE);
+    e_irq_mask(E_USER_INT, E_FALSE);
 #endif
     // Enable interrupts globally
     e_irq_global_mask(E_FALSE);
 
     _init_local_malloc();
 
-    // Copy stream descriptors to local memory
-    // TODO: do this only when the stream is opened
-    // and send them back when closed so that streams
-    // can change owner
-    unsigned int nbytes =
-        combuf->n_streams[coredata.pid] * sizeof(ebsp_stream_descriptor);
-    coredata.local_streams = ebsp_malloc(nbytes);
-    ebsp_memcpy(coredata.local_streams, combuf->extmem_streams[coredata.pid],
-                nbytes);
-
     // Send &syncstate to ARM
     if (coredata.pid == 0)
         combuf->syncstate_ptr = (int8_t*)&coredata.syncstate;
@@ -108,8 +110,7 @@ void EXT_MEM_TEXT bsp_begin() {
 #ifdef DEBUG
     // Wait for ARM before starting
     _write_syncstate(STATE_EREADY);
-    while (coredata.syncstate != STATE_CONTINUE) {
-    }
+    _wait_for_continue();
 #endif
     _write_syncstate(STATE_RUN);
 
@@ -180,6 +181,7 @@ void bsp_sync() {
 
     coredata.tagsize = coredata.tagsize_next;
     coredata.message_index = 0;
+    coredata.superstep++;
 
     e_barrier(coredata.sync_barrier, coredata.sync_barrier_tgt);
 }
@@ -190,9 +192,27 @@ void ebsp_barrier() {
 
 void ebsp_host_sync() {
     _write_syncstate(STATE_SYNC);
+    _wait_for_continue();
+    _write_syncstate(STATE_RUN);
+}
+
+// Waits for the host to write STATE_CONTINUE to syncstate. The host raises
+// the user interrupt after doing so, so the core can sleep instead of
+// polling its own memory. The interrupt state of the caller is restored
+// afterwards.
+void _wait_for_continue() {
+    // Bit 1 of the status register is GID, set when interrupts are disabled
+    unsigned status;
+    __asm__ __volatile__("movfs %0, status" : "=r"(status));
+    int irq_disabled = (status >> 1) & 1;
+
+    e_irq_global_mask(E_TRUE);
     while (coredata.syncstate != STATE_CONTINUE) {
+        _ebsp_sleep();
+        e_irq_global_mask(E_TRUE);
     }
-    _write_syncstate(STATE_RUN);
+    if (!irq_disabled)
+        e_irq_global_mask(E_FALSE);
 }
 
 void _write_syncstate(int8_t state) {
@@ -210,6 +230,11 @@ void __attribute__((interrupt)) _int_isr() {
     return;
 }
 
+void __attribute__((interrupt)) _user_interrupt() {
+    // Raised by the host after writing syncstate
+    _skip_idle();
+}
+
 // Assumes the mutex `ebsp_message_mutex` is locked
 void EXT_MEM_TEXT ebsp_send_string(const char* string) {
     // Write the message
@@ -217,8 +242,7 @@ void EXT_MEM_TEXT ebsp_send_string(const char* string) {
 
     // Wait for message to be written
     _write_syncstate(STATE_MESSAGE);
-    while (coredata.syncstate != STATE_CONTINUE) {
-    };
+    _wait_for_continue();
     _write_syncstate(STATE_RUN);
 }
 
@@ -37,10 +37,270 @@ const char err_stream_full[] EXT_MEM_RO =
 const char err_up_size_warning[] EXT_MEM_RO =
     "BSP WARNING: Moving token of size %d up to stream %d with max token size %d";
 
+const char err_stream_read_only[] EXT_MEM_RO =
+    "BSP ERROR: stream %d is shared and can not be moved up to";
+
+const char err_stream_distributed[] EXT_MEM_RO =
+    "BSP ERROR: can not seek in stream %d, its tokens are distributed";
+
+const char err_stream_encoded[] EXT_MEM_RO =
+    "BSP ERROR: stream %d is encoded and can not be moved up to";
+
+const char err_stream_batch_encoded[] EXT_MEM_RO =
+    "BSP ERROR: stream %d is encoded and can not be moved down in batches";
+
+const char err_stream_pipe_read[] EXT_MEM_RO =
+    "BSP ERROR: stream %d is the read end of a pipe and can not be moved up to";
+
+const char err_stream_pipe_write[] EXT_MEM_RO =
+    "BSP ERROR: stream %d is the write end of a pipe and can not be moved down";
+
+const char err_stream_pipe_seek[] EXT_MEM_RO =
+    "BSP ERROR: can not seek in stream %d, it is a pipe";
+
+const char err_stream_batch_pipe[] EXT_MEM_RO =
+    "BSP ERROR: stream %d is a pipe and can not be moved down in batches";
+
+const char err_stream_not_acquired[] EXT_MEM_RO =
+    "BSP ERROR: no buffer of stream %d was acquired before the commit";
+
 const char err_token_size[] EXT_MEM_RO =
     "BSP ERROR: Stream contained token larger (%d) than maximum token size (%d) for stream. (truncated)";
 
-void _ebsp_read_chunk(ebsp_stream* stream, void* target) {
+// When stream headers are interleaved, they are saved as:
+//
+// 00000000, nextsize, data,
+// prevsize, nextsize, data,
+// ...
+// prevsize, nextsize, data,
+// prevsize, 00000000
+//
+// So a header consists of two integers (8 byte total).
+// The two sizes do NOT include these headers.
+// They are only the size of the data inbetween.
+// The local copies of the data include these 8 bytes.
+//
+// Tokens that are moved down are kept in a ring of `depth` slots.
+// The slot at `ring_head` holds the token that was last given to the user,
+// and the `ring_count` slots after it hold the tokens that are prefetched
+// (possibly with their transfer still in progress). The cursor is always
+// behind the last prefetched token.
+
+// Every stream keeps track of the number of the token at the cursor,
+// so that seeks can jump to a token directly. If the stream has a token
+// index, the index gives the offset of every token. Otherwise, if all
+// tokens except the last one have size max_chunksize (as is the case for
+// streams created by the host), the offset is computed. Only streams that
+// are written by cores with tokens of different sizes have to be walked.
+
+// Moves the cursor to a token, for streams with an index or uniform tokens.
+// Assumes 0 <= token <= ntokens.
+void _ebsp_jump(ebsp_stream* stream, int token) {
+    if (stream->raw) {
+        stream->cursor = stream->extmem_start + token * stream->max_chunksize;
+        if (stream->cursor > stream->extmem_end)
+            stream->cursor = stream->extmem_end;
+    } else if (stream->token_index != NULL) {
+        stream->cursor = stream->extmem_start + stream->token_index[token];
+    } else if (token == 0) {
+        stream->cursor = stream->extmem_start;
+    } else {
+        // The last token can be smaller, so the end of the stream
+        // is found from the header of the last token
+        int last = (token == stream->ntokens);
+        stream->cursor = stream->extmem_start +
+                         (token - last) * (stream->max_chunksize + 2 * sizeof(int));
+        if (last)
+            stream->cursor += 2 * sizeof(int) + *(int*)(stream->cursor + sizeof(int));
+    }
+    stream->position = token;
+}
+
+// Moves the cursor by walking over the headers
+void _ebsp_walk(ebsp_stream* stream, int delta_tokens) {
+    if (delta_tokens >= 0) { // forward
+        while (delta_tokens--) {
+            // read 2nd int (next size) in header
+            int chunk_size = *(int*)(stream->cursor + sizeof(int));
+            if (chunk_size == 0)
+                break;
+            stream->cursor += 2 * sizeof(int) + chunk_size;
+            stream->position++;
+        }
+    } else { // backward
+        while (delta_tokens++) {
+            // read 1st int (prev size) in header
+            int chunk_size = *(int*)(stream->cursor);
+            if (chunk_size == 0)
+                break;
+            stream->cursor -= 2 * sizeof(int) + chunk_size;
+            stream->position--;
+        }
+    }
+}
+
+// The tokens of a distributed stream are claimed one by one by the cores
+// that have the stream open. Every chunk that is read from such a stream
+// is first claimed, so a prefetched token is claimed as soon as its
+// transfer starts.
+
+// A core that closes the stream while it has tokens preloaded gives them
+// back (see _ebsp_requeue_prefetched). They are claimed first, one by one.
+
+// Claims up to `count` consecutive tokens of a distributed stream, moves the
+// cursor to the first one, and returns the number of claimed tokens.
+// At the end of the stream the cursor is moved to the end.
+int _ebsp_claim(ebsp_stream* stream, int count) {
+    volatile int* counter = stream->claim;
+    volatile int* nrequeued = stream->nrequeued;
+
+    e_mutex_lock(0, 0, &coredata.stream_mutex);
+    int token = *counter;
+    int n = *nrequeued;
+    if (n > 0) {
+        token = stream->requeue[n - 1];
+        count = 1;
+        *nrequeued = n - 1;
+        while (*nrequeued != n - 1) {
+        }
+    } else if (token < stream->ntokens) {
+        if (count > stream->ntokens - token)
+            count = stream->ntokens - token;
+        *counter = token + count;
+        // Wait until the write has reached extmem, or the next core
+        // could claim the same token after we unlock the mutex
+        while (*counter != token + count) {
+        }
+    } else {
+        token = stream->ntokens;
+        count = 0;
+    }
+    e_mutex_unlock(0, 0, &coredata.stream_mutex);
+
+    _ebsp_jump(stream, token);
+    return count;
+}
+
+// Transfers of a stream are pushed with the priority of the stream, except
+// for a token that the core is waiting for: it gets the highest priority,
+// so that it is not stuck behind prefetches and outgoing tokens of other
+// streams that have not started yet (see _dma_enqueue_priority).
+#define STREAM_PRIORITY_WAITING (DMA_PRIORITY_LEVELS - 1)
+
+void _ebsp_stream_push(ebsp_dma_handle* handle, void* dst, const void* src,
+                       unsigned nbytes, int priority) {
+    if (nbytes == 0)
+        return;
+
+    e_dma_desc_t* desc = (e_dma_desc_t*)handle;
+    _prepare_descriptor(desc, dst, src, nbytes);
+
+    int index = _dma_select_channel(dst, EBSP_DMA_ANY);
+    _dma_enqueue_priority(&coredata.dma[index], desc, desc, priority);
+}
+
+// Waits for a transfer, and counts the cycles as stalled
+void _ebsp_stream_wait(ebsp_stream* stream, ebsp_dma_handle* handle) {
+    if (ebsp_dma_test(handle))
+        return;
+    unsigned start = _read_ctimer0();
+    ebsp_dma_wait(handle);
+    stream->stall_cycles += start - _read_ctimer0();
+}
+
+// A pipe is a ring of slots in extmem that is written by the core that has
+// the write end open, and read by the core that has the read end open.
+// Every slot holds a header and a token. Both ends count the tokens they
+// have published in their descriptor: the writer publishes a token when its
+// transfer has finished, and the reader when it has been transferred to
+// local memory, so that its slot can be reused. The cursor of either end is
+// at the slot of the token with number `position`.
+
+// Moves the cursor of a pipe to the next slot
+void _ebsp_pipe_advance(ebsp_stream* stream) {
+    stream->cursor += 2 * sizeof(int) + ((stream->max_chunksize + 8 - 1) / 8) * 8;
+    if (stream->cursor >= stream->extmem_end)
+        stream->cursor = stream->extmem_start;
+}
+
+// Returns 1 if the next token can be read without waiting for the writer
+int _ebsp_pipe_ready(ebsp_stream* stream) {
+    if (stream->pipe_end != PIPE_READ_END)
+        return 1;
+    return *(volatile int*)stream->pipe_peer > stream->position;
+}
+
+// Reads the next token of a pipe into a slot, after waiting until the
+// writer has published it. If the writer has closed the pipe and there are
+// no tokens left, the slot gets a token of size zero.
+void _ebsp_read_pipe(ebsp_stream* stream, ebsp_stream_slot* slot,
+                     int priority) {
+    void* target = slot->buffer;
+    volatile int* written = stream->pipe_peer;
+    volatile int* closed = stream->pipe_closed;
+
+    if (*written <= stream->position) {
+        unsigned start = _read_ctimer0();
+        while (*written <= stream->position && !*closed) {
+        }
+        stream->stall_cycles += start - _read_ctimer0();
+    }
+
+    // The writer publishes its count before it closes the pipe,
+    // so the count has to be read again
+    int chunk_size = 0;
+    if (*written > stream->position) {
+        chunk_size = *(int*)(stream->cursor + sizeof(int));
+        if (chunk_size > stream->max_chunksize) {
+            ebsp_message(err_token_size, chunk_size, stream->max_chunksize);
+            chunk_size = stream->max_chunksize;
+        }
+        _ebsp_stream_push(&slot->e_dma_desc, target + 2 * sizeof(int),
+                          stream->cursor + 2 * sizeof(int), chunk_size,
+                          priority);
+        _ebsp_pipe_advance(stream);
+        stream->position++;
+    }
+
+    *(int*)(target) = 0;
+    *(int*)(target + sizeof(int)) = chunk_size;
+}
+
+// Reads the chunk at the cursor into a slot, and moves the cursor past it
+void _ebsp_read_chunk(ebsp_stream* stream, ebsp_stream_slot* slot,
+                      int priority) {
+    void* target = slot->buffer;
+
+    if (stream->claim != NULL)
+        _ebsp_claim(stream, 1);
+
+    // A slot without transfer counts as finished
+    slot->e_dma_desc.config = 0;
+    slot->position = stream->cursor;
+    slot->token = stream->position;
+
+    if (stream->pipe_end == PIPE_READ_END) {
+        _ebsp_read_pipe(stream, slot, priority);
+        return;
+    }
+
+    if (stream->raw) {
+        // Tokens have a fixed size and there are no headers, so the
+        // transfer can start without reading from extmem first
+        unsigned chunk_size = stream->extmem_end - stream->cursor;
+        if (chunk_size > stream->max_chunksize)
+            chunk_size = stream->max_chunksize;
+        if (chunk_size != 0) {
+            _ebsp_stream_push(&slot->e_dma_desc, target + 2 * sizeof(int),
+                              stream->cursor, chunk_size, priority);
+            stream->cursor += chunk_size;
+            stream->position++;
+        }
+        *(int*)(target) = 0;
+        *(int*)(target + sizeof(int)) = chunk_size;
+        return;
+    }
+
     // read header from ext
     int prev_size = *(int*)(stream->cursor);
     int chunk_size = *(int*)(stream->cursor + sizeof(int));
@@ -49,19 +309,27 @@ void _ebsp_read_chunk(ebsp_stream* stream, void* target) {
     {
         void* dst = target + 2 * sizeof(int);
         void* src = stream->cursor + 2 * sizeof(int);
+        unsigned max_size = stream->max_chunksize;
+
+        // An encoded token is placed behind the space for the decoded token
+        if (stream->encoding != ENCODING_NONE) {
+            dst += stream->max_chunksize;
+            max_size = stream->max_encoded;
+        }
 
         // jump over header+chunk
         stream->cursor = (void*)(((unsigned)(stream->cursor)) +
                                  2 * sizeof(int) + chunk_size);
+        stream->position++;
 
         // If token is too large, truncate it.
         // However DO jump the correct distance with cursor
-        if (chunk_size > stream->max_chunksize) {
-            ebsp_message(err_token_size, chunk_size, stream->max_chunksize);
-            chunk_size = stream->max_chunksize;
+        if (chunk_size > max_size) {
+            ebsp_message(err_token_size, chunk_size, max_size);
+            chunk_size = max_size;
         }
 
-        ebsp_dma_push(&stream->e_dma_desc, dst, src, chunk_size);
+        _ebsp_stream_push(&slot->e_dma_desc, dst, src, chunk_size, priority);
     }
 
     // copy it to local
@@ -71,149 +339,453 @@ void _ebsp_read_chunk(ebsp_stream* stream, void* target) {
     *(int*)(target + sizeof(int)) = chunk_size;
 }
 
-// When stream headers are interleaved, they are saved as:
-//
-// 00000000, nextsize, data,
-// prevsize, nextsize, data,
-// ...
-// prevsize, nextsize, data,
-// prevsize, 00000000
-//
-// So a header consists of two integers (8 byte total).
-// The two sizes do NOT include these headers.
-// They are only the size of the data inbetween.
-// The local copies of the data include these 8 bytes.
+// Reads an unsigned LEB128 varint, and moves the pointer past it
+unsigned _ebsp_read_varint(const uint8_t** src) {
+    unsigned value = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = *(*src)++;
+        value |= (unsigned)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// Decodes a token that was encoded by _encode_token in host_bsp_buffer.c,
+// and returns the size of the decoded token
+int _ebsp_decode(int encoding, void* dst, const void* src) {
+    const int32_t* words = (const int32_t*)src;
+    int32_t* out = (int32_t*)dst;
+    int nwords = words[0] / sizeof(int32_t);
+    const uint8_t* bytes = (const uint8_t*)(words + 1);
+
+    switch (encoding) {
+    case ENCODING_DELTA_VARINT: {
+        uint32_t value = 0;
+        for (int i = 0; i < nwords; i++) {
+            uint32_t zigzag = _ebsp_read_varint(&bytes);
+            value += (zigzag >> 1) ^ -(zigzag & 1);
+            out[i] = value;
+        }
+        break;
+    }
+    case ENCODING_RLE:
+        for (int i = 0; i < nwords;) {
+            unsigned run = _ebsp_read_varint(&bytes);
+            // The word is not aligned
+            int32_t value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+                            ((uint32_t)bytes[3] << 24);
+            bytes += sizeof(int32_t);
+            while (run-- && i < nwords)
+                out[i++] = value;
+        }
+        break;
+    case ENCODING_BITPACK: {
+        int32_t min = words[1];
+        unsigned bits = words[2];
+        const uint32_t* packed = (const uint32_t*)(words + 3);
+        uint32_t mask = (bits == 32) ? 0xffffffff : (1u << bits) - 1;
+        for (int i = 0; i < nwords; i++) {
+            unsigned offset = i * bits;
+            unsigned shift = offset % 32;
+            uint32_t value = packed[offset / 32] >> shift;
+            if (shift + bits > 32)
+                value |= packed[offset / 32 + 1] << (32 - shift);
+            out[i] = min + (value & mask);
+        }
+        break;
+    }
+    default:
+        ebsp_memcpy(dst, bytes, words[0]);
+        break;
+    }
+
+    return words[0];
+}
+
+// Returns the slot that is `i` places after the head, for 0 <= i < depth
+ebsp_stream_slot* _ebsp_stream_slot(ebsp_stream* stream, int i) {
+    int index = stream->ring_head + i;
+    if (index >= stream->depth)
+        index -= stream->depth;
+    return &stream->ring[index];
+}
+
+// Makes sure a slot has a local buffer
+int _ebsp_slot_alloc(ebsp_stream* stream, ebsp_stream_slot* slot) {
+    if (slot->buffer == NULL) {
+        // Encoded tokens are transferred behind the decoded token
+        unsigned nbytes = stream->max_chunksize + 2 * sizeof(int);
+        if (stream->encoding != ENCODING_NONE)
+            nbytes += stream->max_encoded;
+        slot->buffer = ebsp_malloc(nbytes);
+        if (slot->buffer == NULL) {
+            ebsp_message(err_out_of_memory2);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Waits for the tokens that are moved up from the slots, see
+// bsp_stream_acquire, so that they can be read back
+void _ebsp_wait_ring(ebsp_stream* stream) {
+    if (stream->ring == NULL)
+        return;
+    for (int i = 0; i < stream->depth; i++)
+        _ebsp_stream_wait(stream, &stream->ring[i].e_dma_desc);
+}
+
+// Discards all prefetched tokens, and puts the cursor back at the first one
+void _ebsp_discard_prefetched(ebsp_stream* stream) {
+    if (stream->ring_count == 0)
+        return;
+
+    for (int i = 1; i <= stream->ring_count; i++)
+        ebsp_dma_wait(&_ebsp_stream_slot(stream, i)->e_dma_desc);
+
+    stream->cursor = _ebsp_stream_slot(stream, 1)->position;
+    stream->position = _ebsp_stream_slot(stream, 1)->token;
+    stream->ring_count = 0;
+}
+
+// Gives the prefetched tokens of a distributed stream back, so that other
+// cores claim them. They have been claimed by this core, so discarding them
+// would mean that no core processes them.
+void _ebsp_requeue_prefetched(ebsp_stream* stream) {
+    if (stream->ring_count == 0)
+        return;
+
+    volatile int* nrequeued = stream->nrequeued;
+
+    for (int i = 1; i <= stream->ring_count; i++)
+        ebsp_dma_wait(&_ebsp_stream_slot(stream, i)->e_dma_desc);
+
+    e_mutex_lock(0, 0, &coredata.stream_mutex);
+    int n = *nrequeued;
+    for (int i = 1; i <= stream->ring_count; i++) {
+        ebsp_stream_slot* slot = _ebsp_stream_slot(stream, i);
+        // The end of the stream is not a token
+        if (((int*)slot->buffer)[1] != 0)
+            stream->requeue[n++] = slot->token;
+    }
+    *nrequeued = n;
+    // As in _ebsp_claim, wait until the writes have reached extmem
+    while (*nrequeued != n) {
+    }
+    e_mutex_unlock(0, 0, &coredata.stream_mutex);
+
+    stream->ring_count = 0;
+}
+
+// The host can read the tokens that are moved up while the core runs, see
+// bsp_stream_reader_poll in host_bsp_buffer.c. The descriptor holds the
+// offset up to which the data in the stream has arrived in extmem. Tokens
+// are published in order, so the offset is only moved past a token when the
+// transfers of all tokens before it have finished as well. This does not
+// wait for transfers; unfinished tokens are published at a later call.
+void _ebsp_publish_up(ebsp_stream* stream) {
+    if (stream->pipe_end != PIPE_NONE || stream->shared)
+        return;
+    if (!ebsp_dma_test(&stream->e_dma_desc))
+        return;
+
+    void* end = stream->cursor;
+    if (stream->ring != NULL) {
+        for (int i = 0; i < stream->depth; i++) {
+            ebsp_stream_slot* slot = &stream->ring[i];
+            if (!ebsp_dma_test(&slot->e_dma_desc) && slot->position < end)
+                end = slot->position;
+        }
+    }
+
+    unsigned offset = end - stream->extmem_start;
+    if (offset > stream->published) {
+        stream->published = offset;
+        combuf->streams[stream->id].published = offset;
+    }
+}
 
 int bsp_stream_open(ebsp_stream* stream, int stream_id) {
+    return bsp_stream_open_prefetch(stream, stream_id, 2);
+}
+
+int bsp_stream_open_prefetch(ebsp_stream* stream, int stream_id, int depth) {
     if (stream_id >= combuf->nstreams) {
         ebsp_message(err_no_such_stream2);
         return 0;
     }
     ebsp_stream_descriptor* s = &(combuf->streams[stream_id]);
 
-    int mypid = coredata.pid;
+    // A shared stream is never written, so it has no owner
+    int shared = s->shared;
+    if (!shared) {
+        int mypid = coredata.pid;
 
-    e_mutex_lock(0, 0, &coredata.stream_mutex);
-    if (s->pid == -1) {
-        s->pid = mypid;
-        mypid = -1;
-    }
-    e_mutex_unlock(0, 0, &coredata.stream_mutex);
+        e_mutex_lock(0, 0, &coredata.stream_mutex);
+        if (s->pid == -1) {
+            s->pid = mypid;
+            mypid = -1;
+        }
+        e_mutex_unlock(0, 0, &coredata.stream_mutex);
 
-    if (mypid != -1) {
-        ebsp_message(err_stream_in_use, stream_id);
-        return 0;
+        if (mypid != -1) {
+            ebsp_message(err_stream_in_use, stream_id);
+            return 0;
+        }
     }
 
     // Fill stream struct
     stream->id = stream_id;
     stream->extmem_start = s->extmem_addr;
     stream->extmem_end = stream->extmem_start + s->nbytes;
-    stream->current_buffer = NULL;
-    stream->next_buffer = NULL;
+    stream->e_dma_desc.config = 0;
+    stream->ring = NULL;
+    stream->depth = depth < 1 ? 1 : depth;
+    stream->ring_head = 0;
+    stream->ring_count = 0;
+    stream->acquired = 0;
+    stream->ntokens = s->ntokens;
+    stream->token_index = s->token_index;
+    stream->raw = s->raw;
+    stream->shared = shared;
+    stream->claim = (s->claim >= 0) ? &s->claim : NULL;
+    stream->requeue = s->requeue;
+    stream->nrequeued = &s->nrequeued;
+    stream->encoding = s->encoding;
+    stream->max_encoded = s->max_encoded;
     stream->max_chunksize = s->max_chunksize;
+    stream->priority = 0;
+    stream->stall_cycles = 0;
+    stream->last_token = -1;
+    stream->batch = NULL;
+    stream->batch_capacity = 0;
+
+    stream->published = s->published;
+
+    stream->pipe_end = s->pipe_end;
+    if (stream->pipe_end != PIPE_NONE) {
+        ebsp_stream_descriptor* peer = &(combuf->streams[s->pipe_peer]);
+        stream->pipe_slots =
+            s->nbytes /
+            (2 * sizeof(int) + ((s->max_chunksize + 8 - 1) / 8) * 8);
+        stream->pipe_count = &s->pipe_count;
+        stream->pipe_peer = &peer->pipe_count;
+        if (stream->pipe_end == PIPE_WRITE_END) {
+            stream->pipe_closed = &s->pipe_closed;
+            *stream->pipe_closed = 0;
+        } else {
+            stream->pipe_closed = &peer->pipe_closed;
+        }
+    }
 
-    // Go to start
-    stream->cursor = stream->extmem_start;
+    // Continue where the stream was closed, which is the start of the stream
+    // if it was not opened before during this ebsp_spmd()
+    stream->cursor = s->cursor;
+    stream->position = s->position;
 
     return stream->max_chunksize;
 }
 
 void bsp_stream_close(ebsp_stream* stream) {
+    // The position to publish is right after the token that was
+    // last moved down, regardless of the tokens that were preloaded.
+    // A distributed stream has no position, but its preloaded tokens
+    // are given back to the other cores.
+    if (stream->claim != NULL)
+        _ebsp_requeue_prefetched(stream);
+    else
+        _ebsp_discard_prefetched(stream);
+
     // Wait for any data transfer to finish before closing
     ebsp_dma_wait(&stream->e_dma_desc);
 
-    if (stream->current_buffer != NULL) {
-        ebsp_free(stream->current_buffer);
-        stream->current_buffer = NULL;
+    if (stream->ring != NULL) {
+        for (int i = 0; i < stream->depth; i++) {
+            ebsp_stream_slot* slot = &stream->ring[i];
+            if (slot->buffer != NULL) {
+                ebsp_dma_wait(&slot->e_dma_desc);
+                ebsp_free(slot->buffer);
+            }
+        }
+        ebsp_free(stream->ring);
+        stream->ring = NULL;
+    }
+    stream->ring_count = 0;
+
+    if (stream->batch != NULL) {
+        ebsp_free(stream->batch);
+        stream->batch = NULL;
     }
-    if (stream->next_buffer != NULL) {
-        ebsp_free(stream->next_buffer);
-        stream->next_buffer = NULL;
+
+    _ebsp_publish_up(stream);
+
+    // The reader sees the end of the stream after the last token.
+    // These writes reach extmem in this order.
+    if (stream->pipe_end == PIPE_WRITE_END) {
+        *stream->pipe_count = stream->position;
+        *stream->pipe_closed = 1;
     }
 
-    // Should not have to lock mutex for this atomic write
-    combuf->streams[stream->id].pid = -1;
+    if (!stream->shared) {
+        // Publish the cursor, so that the next core that opens the stream
+        // continues where this core stopped. These writes arrive before
+        // the write of pid, which goes to extmem along the same path.
+        combuf->streams[stream->id].cursor = stream->cursor;
+        combuf->streams[stream->id].position = stream->position;
+
+        // Tokens that were moved up can change the number of tokens
+        combuf->streams[stream->id].ntokens = stream->ntokens;
+
+        // Should not have to lock mutex for this atomic write
+        combuf->streams[stream->id].pid = -1;
+    }
     stream->id = -1;
 }
 
 void bsp_stream_seek(ebsp_stream* stream, int delta_tokens) {
-    if (delta_tokens >= 0) { // forward
-        while (delta_tokens--) {
-            // read 2nd int (next size) in header
-            int chunk_size = *(int*)(stream->cursor + sizeof(int));
-            if (chunk_size == 0)
-                break;
-            stream->cursor += 2 * sizeof(int) + chunk_size;
-        }
-    } else { // backward
-        if (delta_tokens == INT_MIN) {
-            stream->cursor = stream->extmem_start;
-        } else {
-            while (delta_tokens++) {
-                // read 1st int (prev size) in header
-                int chunk_size = *(int*)(stream->cursor);
-                if (chunk_size == 0)
-                    break;
-                stream->cursor -= 2 * sizeof(int) + chunk_size;
-            }
-        }
+    if (stream->claim != NULL) {
+        ebsp_message(err_stream_distributed, stream->id);
+        return;
     }
+    if (stream->pipe_end != PIPE_NONE) {
+        ebsp_message(err_stream_pipe_seek, stream->id);
+        return;
+    }
+
+    // If there was anything preloaded, discard it, so that the cursor
+    // is right after the token that was last moved down
+    _ebsp_discard_prefetched(stream);
 
-    // If there was anything preloaded, discard it
-    if (stream->next_buffer != NULL) {
-        // Wait for a possible write to it
-        ebsp_dma_wait(&stream->e_dma_desc);
-        // Free it
-        ebsp_free(stream->next_buffer);
-        stream->next_buffer = NULL;
+    if (delta_tokens == INT_MIN) {
+        stream->cursor = stream->extmem_start;
+        stream->position = 0;
+    } else if (stream->ntokens >= 0) {
+        // Clamp without overflowing
+        int token;
+        if (delta_tokens >= 0)
+            token = (delta_tokens > stream->ntokens - stream->position)
+                        ? stream->ntokens
+                        : stream->position + delta_tokens;
+        else
+            token = (-delta_tokens > stream->position)
+                        ? 0
+                        : stream->position + delta_tokens;
+        _ebsp_jump(stream, token);
+    } else {
+        _ebsp_walk(stream, delta_tokens);
     }
 }
 
-int bsp_stream_move_down(ebsp_stream* stream, void** buffer, int preload) {
-    *buffer = NULL;
+void bsp_stream_seek_to(ebsp_stream* stream, int token) {
+    if (stream->claim != NULL) {
+        ebsp_message(err_stream_distributed, stream->id);
+        return;
+    }
+    if (stream->pipe_end != PIPE_NONE) {
+        ebsp_message(err_stream_pipe_seek, stream->id);
+        return;
+    }
+
+    _ebsp_discard_prefetched(stream);
+
+    if (token < 0)
+        token = 0;
+
+    if (stream->ntokens >= 0) {
+        if (token > stream->ntokens)
+            token = stream->ntokens;
+        _ebsp_jump(stream, token);
+    } else {
+        stream->cursor = stream->extmem_start;
+        stream->position = 0;
+        _ebsp_walk(stream, token);
+    }
+}
+
+void bsp_stream_set_priority(ebsp_stream* stream, int priority) {
+    if (priority < 0)
+        priority = 0;
+    if (priority > EBSP_STREAM_MAX_PRIORITY)
+        priority = EBSP_STREAM_MAX_PRIORITY;
+    stream->priority = priority;
+}
 
-    if (stream->current_buffer == NULL) {
-        stream->current_buffer =
-            ebsp_malloc(stream->max_chunksize + 2 * sizeof(int));
-        if (stream->current_buffer == NULL) {
+unsigned bsp_stream_stall_cycles(const ebsp_stream* stream) {
+    return stream->stall_cycles;
+}
+
+int bsp_stream_tell(const ebsp_stream* stream) {
+    return stream->last_token;
+}
+
+// Makes sure the stream has a ring of slots
+int _ebsp_ring_alloc(ebsp_stream* stream) {
+    if (stream->ring == NULL) {
+        stream->ring = ebsp_malloc(stream->depth * sizeof(ebsp_stream_slot));
+        if (stream->ring == NULL) {
             ebsp_message(err_out_of_memory2);
             return 0;
         }
+        for (int i = 0; i < stream->depth; i++) {
+            stream->ring[i].e_dma_desc.config = 0;
+            stream->ring[i].buffer = NULL;
+        }
+        stream->ring_head = 0;
+        stream->ring_count = 0;
     }
+    return 1;
+}
 
-    // Wait for any previous transfer to finish (either down or up)
-    ebsp_dma_wait(&(stream->e_dma_desc));
+int bsp_stream_move_down(ebsp_stream* stream, void** buffer, int preload) {
+    *buffer = NULL;
+
+    if (stream->pipe_end == PIPE_WRITE_END) {
+        ebsp_message(err_stream_pipe_write, stream->id);
+        return 0;
+    }
+
+    if (!_ebsp_ring_alloc(stream))
+        return 0;
+
+    // Wait for any previous transfer to finish (up)
+    _ebsp_stream_wait(stream, &(stream->e_dma_desc));
 
     // At this point in the code:
-    //  current_buffer contains data from previous token,
+    //  the head slot contains data from previous token,
     //  which has been given to the user last time (zero at first time).
-    // This means current_buffer can be overwritten now
+    // This means the head slot can be overwritten now
     // The new token is:
-    //  - locally available already in next_buffer (preload)
+    //  - in the next slot already, or on its way (preload)
     //  - not here yet (no preload)
 
-    if (stream->next_buffer == NULL) {
+    if (stream->ring_count == 0) {
         // Data not here yet (did not preload last time)
-        // Overwrite current buffer.
-        _ebsp_read_chunk(stream, stream->current_buffer);
-        ebsp_dma_wait(&(stream->e_dma_desc));
+        // Overwrite the head slot.
+        _ebsp_wait_ring(stream);
+        ebsp_stream_slot* slot = &stream->ring[stream->ring_head];
+        if (!_ebsp_slot_alloc(stream, slot))
+            return 0;
+        _ebsp_read_chunk(stream, slot, STREAM_PRIORITY_WAITING);
     } else {
-        // Data is locally available already in next_buffer (preload).
-        // Swap buffers.
-        void* tmp = stream->current_buffer;
-        stream->current_buffer = stream->next_buffer;
-        stream->next_buffer = tmp;
+        // Data is in the next slot (preload).
+        stream->ring_head = _ebsp_stream_slot(stream, 1) - stream->ring;
+        stream->ring_count--;
     }
 
+    ebsp_stream_slot* current = &stream->ring[stream->ring_head];
+    _ebsp_stream_wait(stream, &current->e_dma_desc);
+    stream->last_token = current->token;
+
     // At this point in the code:
-    //  current_buffer contains data from the current token,
+    //  the head slot contains data from the current token,
     //  which we should now give to the user.
 
     // *buffer must point after the header
-    (*buffer) = (void*)((unsigned)stream->current_buffer + 2 * sizeof(int));
+    (*buffer) = (void*)((unsigned)current->buffer + 2 * sizeof(int));
 
-    int* header = (int*)(stream->current_buffer);
+    int* header = (int*)(current->buffer);
     int current_chunk_size = header[1];
 
     // Check for end-of-stream
@@ -222,36 +794,241 @@ int bsp_stream_move_down(ebsp_stream* stream, void** buffer, int preload) {
         return 0;
     }
 
+    // The slot of the token in the pipe can be reused by the writer
+    if (stream->pipe_end == PIPE_READ_END)
+        *stream->pipe_count = current->token + 1;
+
     if (preload) {
-        if (stream->next_buffer == NULL) {
-            // no next buffer available, malloc it
-            stream->next_buffer =
-                ebsp_malloc(stream->max_chunksize + 2 * sizeof(int));
-            if (stream->next_buffer == NULL) {
-                ebsp_message(err_out_of_memory2);
-                return 0;
-            }
-        }
-        _ebsp_read_chunk(stream, stream->next_buffer);
-    } else {
-        // free malloced next buffer
-        if (stream->next_buffer != NULL) {
-            ebsp_free(stream->next_buffer);
-            stream->next_buffer = NULL;
+        // Keep up to depth - 1 tokens on their way, but do not read past the
+        // end of the stream
+        int* last =
+            (int*)_ebsp_stream_slot(stream, stream->ring_count)->buffer;
+        // A pipe is only read ahead as far as the writer has published
+        while (stream->ring_count < stream->depth - 1 && last[1] != 0 &&
+               _ebsp_pipe_ready(stream)) {
+            ebsp_stream_slot* slot =
+                _ebsp_stream_slot(stream, stream->ring_count + 1);
+            if (!_ebsp_slot_alloc(stream, slot))
+                break;
+            _ebsp_read_chunk(stream, slot, stream->priority);
+            stream->ring_count++;
+            last = (int*)(slot->buffer);
         }
     }
 
-    // At this point: next_buffer should point to data of NEXT token
+    // At this point: the slots after the head contain the NEXT tokens
+
+    // Decode the token while the next ones are on their way
+    if (stream->encoding != ENCODING_NONE) {
+        current_chunk_size =
+            _ebsp_decode(stream->encoding, *buffer,
+                         *buffer + stream->max_chunksize);
+        header[1] = current_chunk_size;
+    }
 
     return current_chunk_size;
 }
 
-int bsp_stream_move_up(ebsp_stream* stream, const void* data, int data_size,
-                        int wait_for_completion) {
-    ebsp_dma_handle* desc = &stream->e_dma_desc;
+// Moves the cursor past at most `count` tokens that fit in `capacity` bytes,
+// including their headers, and returns the number of tokens
+int _ebsp_batch_span(ebsp_stream* stream, int count, unsigned capacity) {
+    void* start = stream->cursor;
+    int first = stream->position;
 
-    // Wait for any previous transfer to finish (either down or up)
-    ebsp_dma_wait(desc);
+    if (stream->ntokens >= 0) {
+        int n = stream->ntokens - first;
+        if (n > count)
+            n = count;
+        _ebsp_jump(stream, first + n);
+        if ((unsigned)(stream->cursor - start) <= capacity)
+            return n;
+
+        // Some tokens are larger than max_chunksize, so walk instead
+        stream->cursor = start;
+        stream->position = first;
+    }
+
+    int n = 0;
+    while (n < count) {
+        int chunk_size = *(int*)(stream->cursor + sizeof(int));
+        unsigned end = (unsigned)(stream->cursor - start) + 2 * sizeof(int) +
+                       chunk_size;
+        if (chunk_size == 0 || end > capacity)
+            break;
+        stream->cursor += 2 * sizeof(int) + chunk_size;
+        stream->position++;
+        n++;
+    }
+    return n;
+}
+
+int bsp_stream_move_down_batch(ebsp_stream* stream, void** tokens, int* sizes,
+                               int count) {
+    if (count <= 0)
+        return 0;
+    if (stream->encoding != ENCODING_NONE) {
+        ebsp_message(err_stream_batch_encoded, stream->id);
+        return 0;
+    }
+    if (stream->pipe_end != PIPE_NONE) {
+        ebsp_message(err_stream_batch_pipe, stream->id);
+        return 0;
+    }
+
+    // The tokens that a distributed stream has prefetched are claimed by
+    // this core and can not be read again, so they are the first tokens of
+    // the batch. The batch buffer is only used for the tokens after them.
+    int n = 0;
+    if (stream->claim != NULL) {
+        while (n < count && stream->ring_count > 0) {
+            stream->ring_head = _ebsp_stream_slot(stream, 1) - stream->ring;
+            stream->ring_count--;
+            ebsp_stream_slot* slot = &stream->ring[stream->ring_head];
+            _ebsp_stream_wait(stream, &slot->e_dma_desc);
+            int size = ((int*)slot->buffer)[1];
+            if (size == 0) // end of stream
+                return n;
+            if (n == 0)
+                stream->last_token = slot->token;
+            tokens[n] = slot->buffer + 2 * sizeof(int);
+            sizes[n] = size;
+            n++;
+        }
+        if (n == count)
+            return n;
+    }
+
+    // The batch starts after the token that was last moved down
+    _ebsp_discard_prefetched(stream);
+    _ebsp_wait_ring(stream);
+    _ebsp_stream_wait(stream, &stream->e_dma_desc);
+
+    tokens += n;
+    sizes += n;
+    count -= n;
+
+    unsigned capacity = count * (stream->max_chunksize + 2 * sizeof(int));
+    if (stream->batch_capacity < capacity) {
+        if (stream->batch != NULL)
+            ebsp_free(stream->batch);
+        stream->batch = ebsp_malloc(capacity);
+        if (stream->batch == NULL) {
+            stream->batch_capacity = 0;
+            ebsp_message(err_out_of_memory2);
+            return n;
+        }
+        stream->batch_capacity = capacity;
+    }
+
+    if (stream->claim != NULL)
+        count = _ebsp_claim(stream, count);
+
+    // The tokens are consecutive in extmem, headers included,
+    // so they are transferred at once
+    void* start = stream->cursor;
+    int first = stream->position;
+    int m = _ebsp_batch_span(stream, count, capacity);
+    unsigned nbytes = stream->cursor - start;
+    if (m == 0)
+        return n;
+
+    _ebsp_stream_push(&stream->e_dma_desc, stream->batch, start, nbytes,
+                      STREAM_PRIORITY_WAITING);
+    _ebsp_stream_wait(stream, &stream->e_dma_desc);
+    if (n == 0)
+        stream->last_token = first;
+
+    void* p = stream->batch;
+    for (int i = 0; i < m; i++) {
+        if (stream->raw) {
+            unsigned size = nbytes - i * stream->max_chunksize;
+            sizes[i] = (size < stream->max_chunksize) ? size
+                                                      : stream->max_chunksize;
+            tokens[i] = p;
+            p += stream->max_chunksize;
+        } else {
+            sizes[i] = ((int*)p)[1];
+            tokens[i] = p + 2 * sizeof(int);
+            p += 2 * sizeof(int) + sizes[i];
+        }
+    }
+
+    return n + m;
+}
+
+// Waits for the tokens that were moved up to a pipe, and publishes them.
+// This is done before the next token is moved up, so that at most one
+// token of the writer is not yet visible to the reader
+void _ebsp_pipe_publish(ebsp_stream* stream) {
+    _ebsp_stream_wait(stream, &stream->e_dma_desc);
+    _ebsp_wait_ring(stream);
+    *stream->pipe_count = stream->position;
+}
+
+// Moves up a token to the next slot of a pipe, after waiting until the
+// reader has made room for it
+int _ebsp_move_up_pipe(ebsp_stream* stream, ebsp_dma_handle* desc,
+                       const void* data, int data_size) {
+    if (data_size > stream->max_chunksize) {
+        ebsp_message(err_up_size_warning, data_size, stream->id,
+                     stream->max_chunksize);
+        data_size = stream->max_chunksize;
+    }
+
+    _ebsp_pipe_publish(stream);
+
+    volatile int* read = stream->pipe_peer;
+    if (stream->position - *read >= stream->pipe_slots) {
+        unsigned start = _read_ctimer0();
+        while (stream->position - *read >= stream->pipe_slots) {
+        }
+        stream->stall_cycles += start - _read_ctimer0();
+    }
+
+    int* header = (int*)(stream->cursor);
+    header[0] = 0;
+    header[1] = data_size;
+
+    _ebsp_stream_push(desc, stream->cursor + 2 * sizeof(int), data, data_size,
+                      stream->priority);
+    _ebsp_pipe_advance(stream);
+    stream->position++;
+
+    return data_size;
+}
+
+// Every token of a raw stream takes max_chunksize bytes in extmem,
+// so a smaller token leaves the rest of its place unchanged
+int _ebsp_move_up_raw(ebsp_stream* stream, ebsp_dma_handle* desc,
+                      const void* data, int data_size) {
+    if (data_size > stream->max_chunksize) {
+        ebsp_message(err_up_size_warning, data_size, stream->id,
+                     stream->max_chunksize);
+        data_size = stream->max_chunksize;
+    }
+
+    unsigned space_left = (unsigned)stream->extmem_end - (unsigned)stream->cursor;
+    if (space_left < (unsigned)data_size || space_left == 0) {
+        ebsp_message(err_stream_full, stream->id, space_left, data_size);
+        return 0;
+    }
+
+    _ebsp_stream_push(desc, stream->cursor, data, data_size, stream->priority);
+    stream->cursor += (space_left < stream->max_chunksize) ? space_left
+                                                          : stream->max_chunksize;
+    stream->position++;
+
+    return data_size;
+}
+
+// Writes the headers of a token to extmem and starts the transfer of
+// the data using `desc`, without waiting for it
+int _ebsp_move_up(ebsp_stream* stream, ebsp_dma_handle* desc,
+                  const void* data, int data_size) {
+    if (stream->raw)
+        return _ebsp_move_up_raw(stream, desc, data, data_size);
+    if (stream->pipe_end == PIPE_WRITE_END)
+        return _ebsp_move_up_pipe(stream, desc, data, data_size);
 
     // Round data_size up to a multiple of 8
     // If this is not done, integer access to the headers will crash
@@ -281,15 +1058,111 @@ int bsp_stream_move_up(ebsp_stream* stream, const void* data, int data_size,
     header2[0] = data_size;
     header2[1] = 0; // terminating 0
 
+    // Keep the token index, or the uniformity of the tokens, up to date.
+    // The new token is the last one in the stream.
+    if (stream->token_index != NULL) {
+        unsigned offset = stream->cursor - stream->extmem_start;
+        stream->token_index[stream->position] = offset;
+        stream->token_index[stream->position + 1] =
+            offset + 2 * sizeof(int) + data_size;
+        stream->ntokens = stream->position + 1;
+    } else if (stream->ntokens >= 0) {
+        if (data_size > stream->max_chunksize ||
+            (stream->position > 0 && header1[0] != stream->max_chunksize))
+            stream->ntokens = -1;
+        else
+            stream->ntokens = stream->position + 1;
+    }
+    stream->position++;
+
     stream->cursor += 2 * sizeof(int);
 
     // Now write the data to extmem (async)
-    ebsp_dma_push(desc, (void*)(stream->cursor), data, data_size); // start dma
+    _ebsp_stream_push(desc, (void*)(stream->cursor), data, data_size,
+                      stream->priority); // start dma
     stream->cursor += data_size; // move pointer in extmem
 
-    if (wait_for_completion)
-        ebsp_dma_wait(desc);
+    return data_size;
+}
+
+// Returns 1 if tokens can be moved up to the stream
+int _ebsp_check_writable(ebsp_stream* stream) {
+    if (stream->shared) {
+        ebsp_message(err_stream_read_only, stream->id);
+        return 0;
+    }
+    if (stream->encoding != ENCODING_NONE) {
+        ebsp_message(err_stream_encoded, stream->id);
+        return 0;
+    }
+    if (stream->pipe_end == PIPE_READ_END) {
+        ebsp_message(err_stream_pipe_read, stream->id);
+        return 0;
+    }
+    return 1;
+}
+
+int bsp_stream_move_up(ebsp_stream* stream, const void* data, int data_size,
+                        int wait_for_completion) {
+    ebsp_dma_handle* desc = &stream->e_dma_desc;
+
+    if (!_ebsp_check_writable(stream))
+        return 0;
+
+    // Wait for any previous transfer to finish (either down or up)
+    _ebsp_stream_wait(stream, desc);
+    _ebsp_publish_up(stream);
+
+    data_size = _ebsp_move_up(stream, desc, data, data_size);
+
+    if (wait_for_completion) {
+        _ebsp_stream_wait(stream, desc);
+        // The reader does not have to wait for the next token
+        if (stream->pipe_end == PIPE_WRITE_END)
+            _ebsp_pipe_publish(stream);
+        else
+            _ebsp_publish_up(stream);
+    }
 
     return data_size;
 }
 
+// Tokens that are moved up with bsp_stream_acquire and bsp_stream_commit
+// use the same ring of slots as tokens that are moved down. The slot at
+// `ring_head` holds the buffer that was acquired last. Every slot has its
+// own transfer, so up to `depth` tokens can be on their way to extmem.
+
+void* bsp_stream_acquire(ebsp_stream* stream) {
+    if (!_ebsp_check_writable(stream))
+        return NULL;
+    if (!_ebsp_ring_alloc(stream))
+        return NULL;
+
+    // Tokens that were preloaded are overwritten
+    _ebsp_discard_prefetched(stream);
+
+    // Take the oldest slot, and wait until its token has left
+    stream->ring_head = _ebsp_stream_slot(stream, 1) - stream->ring;
+    ebsp_stream_slot* slot = &stream->ring[stream->ring_head];
+    _ebsp_stream_wait(stream, &slot->e_dma_desc);
+    if (!_ebsp_slot_alloc(stream, slot))
+        return NULL;
+    stream->acquired = 1;
+
+    // The token is written behind the space for the header, as for
+    // tokens that are moved down
+    return slot->buffer + 2 * sizeof(int);
+}
+
+int bsp_stream_commit(ebsp_stream* stream, int data_size) {
+    if (!stream->acquired) {
+        ebsp_message(err_stream_not_acquired, stream->id);
+        return 0;
+    }
+    stream->acquired = 0;
+    ebsp_stream_slot* slot = &stream->ring[stream->ring_head];
+    _ebsp_publish_up(stream);
+    slot->position = stream->cursor;
+    return _ebsp_move_up(stream, &slot->e_dma_desc,
+                         slot->buffer + 2 * sizeof(int), data_size);
+}
@@ -46,8 +46,78 @@ const char err_out_of_memory[] EXT_MEM_RO =
 const char err_token_size2[] EXT_MEM_RO =
     "BSP ERROR: Stream contained token larger (%d) than maximum token size (%d) for stream. (truncated)";
 
+const char err_use_closed[] EXT_MEM_RO =
+    "BSP ERROR: tried to use closed stream";
+
+// Descriptors are only copied to local memory while the stream is open.
+// They are kept in a linked list so that local memory use scales with
+// the number of opened streams instead of the number of created streams.
+
+ebsp_stream_descriptor* _ebsp_loaded_stream(unsigned stream_id) {
+    ebsp_loaded_stream* node = coredata.loaded_streams;
+    while (node != NULL) {
+        if (node->id == stream_id)
+            return &node->desc;
+        node = node->next;
+    }
+    return NULL;
+}
+
+// Copy the descriptor from external memory when the stream is opened
+ebsp_stream_descriptor* _ebsp_load_stream(unsigned stream_id) {
+    ebsp_loaded_stream* node = ebsp_malloc(sizeof(ebsp_loaded_stream));
+    if (node == NULL) {
+        ebsp_message(err_out_of_memory);
+        return NULL;
+    }
+
+    ebsp_stream_descriptor* extmem_desc =
+        (ebsp_stream_descriptor*)combuf->extmem_streams[coredata.pid];
+    ebsp_memcpy(&node->desc, &extmem_desc[stream_id],
+                sizeof(ebsp_stream_descriptor));
+
+    node->id = stream_id;
+    node->next = coredata.loaded_streams;
+    coredata.loaded_streams = node;
+    return &node->desc;
+}
+
+// Write the descriptor back to external memory when the stream is closed
+void _ebsp_unload_stream(unsigned stream_id) {
+    ebsp_loaded_stream** link = &coredata.loaded_streams;
+    while (*link != NULL && (*link)->id != stream_id)
+        link = &(*link)->next;
+
+    ebsp_loaded_stream* node = *link;
+    if (node == NULL)
+        return;
+
+    ebsp_stream_descriptor* extmem_desc =
+        (ebsp_stream_descriptor*)combuf->extmem_streams[coredata.pid];
+    ebsp_memcpy(&extmem_desc[stream_id], &node->desc,
+                sizeof(ebsp_stream_descriptor));
+
+    *link = node->next;
+    ebsp_free(node);
+}
+
+// Find the descriptor of an opened stream, or give an error
+ebsp_stream_descriptor* _ebsp_opened_stream(unsigned stream_id) {
+    if (stream_id >= coredata.local_nstreams) {
+        ebsp_message(err_no_such_stream);
+        return NULL;
+    }
+
+    ebsp_stream_descriptor* stream = _ebsp_loaded_stream(stream_id);
+    if (stream == NULL)
+        ebsp_message(err_use_closed);
+    return stream;
+}
+
 void ebsp_set_up_chunk_size(unsigned stream_id, int nbytes) {
-    ebsp_stream_descriptor* out_stream = &coredata.local_streams[stream_id];
+    ebsp_stream_descriptor* out_stream = _ebsp_opened_stream(stream_id);
+    if (out_stream == NULL)
+        return;
 
     int* header = (int*)out_stream->current_buffer;
     // update the *next* value to the new numer of bytes
@@ -60,21 +130,29 @@ int ebsp_open_up_stream(void** address, unsigned stream_id) {
         return 0;
     }
 
-    ebsp_stream_descriptor* stream = &coredata.local_streams[stream_id];
-
-    if (stream->is_down_stream) {
-        ebsp_message(err_mixed_up_down);
+    ebsp_stream_descriptor* opened = _ebsp_loaded_stream(stream_id);
+    if (opened != NULL) {
+        if (opened->is_down_stream)
+            ebsp_message(err_mixed_up_down);
+        else
+            ebsp_message(err_create_opened);
         return 0;
     }
 
-    if (stream->current_buffer != NULL) {
-        ebsp_message(err_create_opened);
+    ebsp_stream_descriptor* stream = _ebsp_load_stream(stream_id);
+    if (stream == NULL)
+        return 0;
+
+    if (stream->is_down_stream) {
+        ebsp_message(err_mixed_up_down);
+        _ebsp_unload_stream(stream_id);
         return 0;
     }
 
     stream->current_buffer = ebsp_malloc(stream->max_chunksize + sizeof(int));
     if (stream->current_buffer == NULL) {
         ebsp_message(err_out_of_memory);
+        _ebsp_unload_stream(stream_id);
         return 0;
     }
 
@@ -95,15 +173,15 @@ void ebsp_close_up_stream(unsigned stream_id) {
         return;
     }
 
-    ebsp_stream_descriptor* out_stream = &coredata.local_streams[stream_id];
+    ebsp_stream_descriptor* out_stream = _ebsp_loaded_stream(stream_id);
 
-    if (out_stream->is_down_stream) {
-        ebsp_message(err_mixed_up_down);
+    if (out_stream == NULL) {
+        ebsp_message(err_close_closed);
         return;
     }
 
-    if (out_stream->current_buffer == NULL) {
-        ebsp_message(err_close_closed);
+    if (out_stream->is_down_stream) {
+        ebsp_message(err_mixed_up_down);
         return;
     }
 
@@ -118,15 +196,14 @@ void ebsp_close_up_stream(unsigned stream_id) {
         ebsp_free(out_stream->next_buffer);
         out_stream->next_buffer = NULL;
     }
+
+    _ebsp_unload_stream(stream_id);
 }
 
 int ebsp_move_chunk_up(void** address, unsigned stream_id, int prealloc) {
-    if (stream_id >= coredata.local_nstreams) {
-        ebsp_message(err_no_such_stream);
+    ebsp_stream_descriptor* stream = _ebsp_opened_stream(stream_id);
+    if (stream == NULL)
         return 0;
-    }
-
-    ebsp_stream_descriptor* stream = &coredata.local_streams[stream_id];
 
     if (stream->is_down_stream) {
         ebsp_message(err_mixed_up_down);
@@ -229,14 +306,22 @@ int ebsp_open_down_stream(void** address, unsigned stream_id) {
         return 0;
     }
 
-    ebsp_stream_descriptor* stream = &coredata.local_streams[stream_id];
+    ebsp_stream_descriptor* opened = _ebsp_loaded_stream(stream_id);
+    if (opened != NULL) {
+        if (!opened->is_down_stream)
+            ebsp_message(err_mixed_up_down);
+        else
+            ebsp_message(err_open_opened);
+        return 0;
+    }
+
+    ebsp_stream_descriptor* stream = _ebsp_load_stream(stream_id);
+    if (stream == NULL)
+        return 0;
 
     if (!stream->is_down_stream) {
         ebsp_message(err_mixed_up_down);
-        return 0;
-    }
-    if (stream->current_buffer != NULL || stream->next_buffer != NULL) {
-        ebsp_message(err_open_opened);
+        _ebsp_unload_stream(stream_id);
         return 0;
     }
 
@@ -247,6 +332,7 @@ int ebsp_open_down_stream(void** address, unsigned stream_id) {
     stream->next_buffer = ebsp_malloc(stream->max_chunksize + 2 * sizeof(int));
     if (stream->next_buffer == NULL) {
         ebsp_message(err_out_of_memory);
+        _ebsp_unload_stream(stream_id);
         return 0;
     }
 
@@ -263,15 +349,15 @@ void ebsp_close_down_stream(unsigned stream_id) {
         return;
     }
 
-    ebsp_stream_descriptor* in_stream = &coredata.local_streams[stream_id];
+    ebsp_stream_descriptor* in_stream = _ebsp_loaded_stream(stream_id);
 
-    if (!(in_stream->is_down_stream)) {
-        ebsp_message(err_mixed_up_down);
+    if (in_stream == NULL) {
+        ebsp_message(err_close_closed);
         return;
     }
 
-    if (in_stream->current_buffer == NULL) {
-        ebsp_message(err_close_closed);
+    if (!(in_stream->is_down_stream)) {
+        ebsp_message(err_mixed_up_down);
         return;
     }
 
@@ -285,15 +371,14 @@ void ebsp_close_down_stream(unsigned stream_id) {
         ebsp_free(in_stream->next_buffer);
         in_stream->next_buffer = NULL;
     }
+
+    _ebsp_unload_stream(stream_id);
 }
 
 int ebsp_move_chunk_down(void** address, unsigned stream_id, int prealloc) {
-    if (stream_id >= coredata.local_nstreams) {
-        ebsp_message(err_no_such_stream);
+    ebsp_stream_descriptor* stream = _ebsp_opened_stream(stream_id);
+    if (stream == NULL)
         return 0;
-    }
-
-    ebsp_stream_descriptor* stream = &coredata.local_streams[stream_id];
 
     ebsp_dma_handle* desc = (ebsp_dma_handle*)(&(stream->e_dma_desc));
 
@@ -365,12 +450,9 @@ int ebsp_move_chunk_down(void** address, unsigned stream_id, int prealloc) {
 }
 
 void ebsp_reset_down_cursor(int stream_id) {
-    if (stream_id >= coredata.local_nstreams) {
-        ebsp_message(err_no_such_stream);
+    ebsp_stream_descriptor* in_stream = _ebsp_opened_stream(stream_id);
+    if (in_stream == NULL)
         return;
-    }
-
-    ebsp_stream_descriptor* in_stream = &coredata.local_streams[stream_id];
 
     size_t chunk_size = -1;
 
@@ -384,12 +466,9 @@ void ebsp_reset_down_cursor(int stream_id) {
 }
 
 void ebsp_move_down_cursor(int stream_id, int jump_n_chunks) {
-    if (stream_id >= coredata.local_nstreams) {
-        ebsp_message(err_no_such_stream);
+    ebsp_stream_descriptor* in_stream = _ebsp_opened_stream(stream_id);
+    if (in_stream == NULL)
         return;
-    }
-
-    ebsp_stream_descriptor* in_stream = &coredata.local_streams[stream_id];
 
     if (jump_n_chunks > 0) // jump forward
     {
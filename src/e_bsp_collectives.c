@@ -0,0 +1,284 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+#include "e_bsp_private.h"
+
+// All collectives are built from rounds that are separated by a barrier.
+// In every round a core writes at most one block of data into the buffer
+// of a partner. Data is always moved by a remote write and never by a
+// remote read. The only remote reads are of the buffer addresses that the
+// partners published in _coll_begin, and in ebsp_alltoallv of the receive
+// displacement that the partner has for this core.
+// Partners are at distance 1, 2, 4 and 8 in pid, so the first rounds
+// stay within a row of the mesh and the later rounds go along a column.
+//
+// Data that has to be combined is written into a scratch buffer of the
+// receiver, which has two slots that are used in alternating rounds.
+// A core combines the data of a round directly after the barrier of that
+// round, and the slot is only written again after the next barrier, so
+// no extra barrier is needed before the slot can be reused.
+
+const char err_coll_out_of_memory[] EXT_MEM_RO =
+    "BSP ERROR: could not allocate %d bytes of scratch space for collective";
+
+// Returns the global address of the buffer that pid published
+// in the field coredata.coll_buffer or coredata.coll_scratch
+static void* _published(int pid, void* const* field) {
+    unsigned remote_field = (unsigned)field;
+    remote_field |= ((uint32_t)coredata.coreids[pid]) << 20;
+    return _to_global_addr(pid, *(void**)remote_field);
+}
+
+// Publishes the buffers of this core for the collective, allocating
+// scratch_size bytes of scratch space, and waits for all cores to do so
+static void* _coll_begin(void* buffer, int scratch_size) {
+    void* scratch = 0;
+    if (scratch_size != 0) {
+        scratch = ebsp_malloc(scratch_size);
+        if (scratch == 0)
+            scratch = ebsp_ext_malloc(scratch_size);
+        if (scratch == 0)
+            bsp_abort(err_coll_out_of_memory, scratch_size);
+    }
+    coredata.coll_buffer = buffer;
+    coredata.coll_scratch = scratch;
+    ebsp_barrier();
+    return scratch;
+}
+
+// Pid of a virtual rank in a tree with the given root
+static int _real_pid(int vrank, int root) {
+    int pid = vrank + root;
+    if (pid >= coredata.nprocs)
+        pid -= coredata.nprocs;
+    return pid;
+}
+
+unsigned ebsp_broadcast(void* data, int nbytes, int root) {
+    unsigned start = _read_ctimer0();
+    int p = coredata.nprocs;
+    int vrank = coredata.pid - root;
+    if (vrank < 0)
+        vrank += p;
+
+    _coll_begin(data, 0);
+
+    // Binomial tree: in round d, ranks below d send to rank + d
+    for (int d = 1; d < p; d <<= 1) {
+        if (vrank < d && vrank + d < p) {
+            int partner = _real_pid(vrank + d, root);
+            ebsp_memcpy(_published(partner, &coredata.coll_buffer), data,
+                        nbytes);
+        }
+        ebsp_barrier();
+    }
+
+    return start - _read_ctimer0();
+}
+
+unsigned ebsp_reduce(const void* src, void* dst, int nbytes,
+                     ebsp_combiner op, int root) {
+    unsigned start = _read_ctimer0();
+    int p = coredata.nprocs;
+    int vrank = coredata.pid - root;
+    if (vrank < 0)
+        vrank += p;
+    int slot_size = (nbytes + 7) & ~7;
+
+    // Scratch is two receive slots followed by the accumulator.
+    // The root accumulates directly into dst.
+    void* scratch = _coll_begin(dst, 3 * slot_size);
+    void* acc = (vrank == 0 ? dst : scratch + 2 * slot_size);
+    if (acc != src)
+        ebsp_memcpy(acc, src, nbytes);
+
+    // Binomial tree: in round d, ranks that are an odd multiple of d
+    // send their partial result to rank - d
+    int slot = 0;
+    for (int d = 1; d < p; d <<= 1) {
+        if ((vrank & (2 * d - 1)) == d) {
+            int partner = _real_pid(vrank - d, root);
+            void* remote = _published(partner, &coredata.coll_scratch);
+            ebsp_memcpy(remote + slot, acc, nbytes);
+        }
+        ebsp_barrier();
+        if ((vrank & (2 * d - 1)) == 0 && vrank + d < p)
+            op(acc, scratch + slot, nbytes);
+        slot ^= slot_size;
+    }
+
+    ebsp_free(scratch);
+    return start - _read_ctimer0();
+}
+
+unsigned ebsp_allreduce(const void* src, void* dst, int nbytes,
+                        ebsp_combiner op) {
+    unsigned start = _read_ctimer0();
+    int p = coredata.nprocs;
+
+    if ((p & (p - 1)) != 0) {
+        // Recursive doubling needs a power of two
+        ebsp_reduce(src, dst, nbytes, op, 0);
+        ebsp_broadcast(dst, nbytes, 0);
+        return start - _read_ctimer0();
+    }
+
+    int slot_size = (nbytes + 7) & ~7;
+    void* scratch = _coll_begin(dst, 2 * slot_size);
+    if (dst != src)
+        ebsp_memcpy(dst, src, nbytes);
+
+    // Recursive doubling: in round d, exchange with pid ^ d
+    int slot = 0;
+    for (int d = 1; d < p; d <<= 1) {
+        int partner = coredata.pid ^ d;
+        void* remote = _published(partner, &coredata.coll_scratch);
+        ebsp_memcpy(remote + slot, dst, nbytes);
+        ebsp_barrier();
+        op(dst, scratch + slot, nbytes);
+        slot ^= slot_size;
+    }
+
+    ebsp_free(scratch);
+    return start - _read_ctimer0();
+}
+
+unsigned ebsp_scan(const void* src, void* dst, int nbytes, ebsp_combiner op) {
+    unsigned start = _read_ctimer0();
+    int p = coredata.nprocs;
+    int s = coredata.pid;
+    int slot_size = (nbytes + 7) & ~7;
+
+    void* scratch = _coll_begin(dst, 2 * slot_size);
+    if (dst != src)
+        ebsp_memcpy(dst, src, nbytes);
+
+    // Hillis-Steele: in round d, send the partial prefix to pid + d
+    int slot = 0;
+    for (int d = 1; d < p; d <<= 1) {
+        if (s + d < p) {
+            void* remote = _published(s + d, &coredata.coll_scratch);
+            ebsp_memcpy(remote + slot, dst, nbytes);
+        }
+        ebsp_barrier();
+        if (s >= d)
+            op(dst, scratch + slot, nbytes);
+        slot ^= slot_size;
+    }
+
+    ebsp_free(scratch);
+    return start - _read_ctimer0();
+}
+
+unsigned ebsp_gather(const void* src, void* dst, int nbytes, int root) {
+    unsigned start = _read_ctimer0();
+
+    _coll_begin(dst, 0);
+
+    // Every core writes its block directly to the root
+    void* remote = _published(root, &coredata.coll_buffer);
+    ebsp_memcpy(remote + coredata.pid * nbytes, src, nbytes);
+    ebsp_barrier();
+
+    return start - _read_ctimer0();
+}
+
+// Partner that this core sends to in round r of a personalized exchange.
+// For a power of two this is pairwise, so when the cores are in the same
+// round each core exchanges data with one other core. Otherwise every core
+// sends to the core r further, and receives from the core r back.
+// The rounds only fix the order of the sends, they are not synchronized.
+static int _exchange_partner(int r, int p) {
+    if ((p & (p - 1)) == 0)
+        return coredata.pid ^ r;
+    int partner = coredata.pid + r;
+    if (partner >= p)
+        partner -= p;
+    return partner;
+}
+
+unsigned ebsp_alltoall(const void* src, void* dst, int nbytes) {
+    unsigned start = _read_ctimer0();
+    int p = coredata.nprocs;
+    ebsp_dma_handle handles[NPROCS];
+
+    _coll_begin(dst, 0);
+
+    // All blocks are queued on the DMA engine in the order of the rounds,
+    // spread over both channels. Since the blocks have equal size, the
+    // cores stay roughly in step. Round 0 is the block for this core itself,
+    // which is copied by the core while the others are transferred, since
+    // the DMA engine can not copy from a core to itself.
+    if (nbytes != 0) {
+        for (int r = 1; r < p; r++) {
+            int partner = _exchange_partner(r, p);
+            void* remote = _published(partner, &coredata.coll_buffer);
+            ebsp_dma_push_channel(&handles[r], remote + coredata.pid * nbytes,
+                                  src + partner * nbytes, nbytes,
+                                  EBSP_DMA_ANY);
+        }
+        ebsp_memcpy(dst + coredata.pid * nbytes, src + coredata.pid * nbytes,
+                    nbytes);
+        for (int r = 1; r < p; r++)
+            ebsp_dma_wait(&handles[r]);
+    }
+    ebsp_barrier();
+
+    return start - _read_ctimer0();
+}
+
+unsigned ebsp_alltoallv(const void* src, const int* sendcounts,
+                        const int* sdispls, void* dst, const int* rdispls) {
+    unsigned start = _read_ctimer0();
+    int p = coredata.nprocs;
+    ebsp_dma_handle handles[NPROCS];
+
+    // The receive displacements are published so that
+    // every sender can write directly to the right place
+    coredata.coll_buffer = dst;
+    coredata.coll_scratch = (void*)rdispls;
+    ebsp_barrier();
+
+    // Round 0 is the block for this core itself, see ebsp_alltoall
+    for (int r = 1; r < p; r++) {
+        int partner = _exchange_partner(r, p);
+        if (sendcounts[partner] == 0)
+            continue;
+        void* remote = _published(partner, &coredata.coll_buffer);
+        const int* remote_rdispls =
+            _published(partner, &coredata.coll_scratch);
+        ebsp_dma_push_channel(&handles[r],
+                              remote + remote_rdispls[coredata.pid],
+                              src + sdispls[partner], sendcounts[partner],
+                              EBSP_DMA_ANY);
+    }
+    int s = coredata.pid;
+    if (sendcounts[s] != 0)
+        ebsp_memcpy(dst + rdispls[s], src + sdispls[s], sendcounts[s]);
+    for (int r = 1; r < p; r++)
+        if (sendcounts[_exchange_partner(r, p)] != 0)
+            ebsp_dma_wait(&handles[r]);
+    ebsp_barrier();
+
+    return start - _read_ctimer0();
+}
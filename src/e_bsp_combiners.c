@@ -0,0 +1,76 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+#include "e_bsp_private.h"
+
+// The built-in combiners are small, so they are kept in local memory
+// which makes them cheap to call in a loop.
+
+void ebsp_combine_int_sum(void* accumulated, const void* payload, int nbytes) {
+    int* a = accumulated;
+    const int* b = payload;
+    for (int i = 0; i < nbytes / (int)sizeof(int); i++)
+        a[i] += b[i];
+}
+
+void ebsp_combine_int_min(void* accumulated, const void* payload, int nbytes) {
+    int* a = accumulated;
+    const int* b = payload;
+    for (int i = 0; i < nbytes / (int)sizeof(int); i++)
+        if (b[i] < a[i])
+            a[i] = b[i];
+}
+
+void ebsp_combine_int_max(void* accumulated, const void* payload, int nbytes) {
+    int* a = accumulated;
+    const int* b = payload;
+    for (int i = 0; i < nbytes / (int)sizeof(int); i++)
+        if (b[i] > a[i])
+            a[i] = b[i];
+}
+
+void ebsp_combine_float_sum(void* accumulated, const void* payload,
+                            int nbytes) {
+    float* a = accumulated;
+    const float* b = payload;
+    for (int i = 0; i < nbytes / (int)sizeof(float); i++)
+        a[i] += b[i];
+}
+
+void ebsp_combine_float_min(void* accumulated, const void* payload,
+                            int nbytes) {
+    float* a = accumulated;
+    const float* b = payload;
+    for (int i = 0; i < nbytes / (int)sizeof(float); i++)
+        if (b[i] < a[i])
+            a[i] = b[i];
+}
+
+void ebsp_combine_float_max(void* accumulated, const void* payload,
+                            int nbytes) {
+    float* a = accumulated;
+    const float* b = payload;
+    for (int i = 0; i < nbytes / (int)sizeof(float); i++)
+        if (b[i] > a[i])
+            a[i] = b[i];
+}
@@ -22,7 +22,6 @@ see the files COPYING and COPYING.LESSER. If not, see
 
 #include "e_bsp_private.h"
 
-#define local_mask (0xfff00000)
 extern unsigned dma_data_size[8];
 
 void _prepare_descriptor(e_dma_desc_t* desc, void* dst, const void* src,
@@ -43,6 +42,131 @@ void _prepare_descriptor(e_dma_desc_t* desc, void* dst, const void* src,
     desc->dst_addr = (void*)dst;
 }
 
+// Like _prepare_descriptor, but copies `rows` rows of `nbytes` each.
+// The DMA engine adds the inner stride after every element of a row,
+// and the outer stride instead after the last element of a row, so the
+// outer stride is the row stride minus the length of the row without its
+// last element.
+void _prepare_descriptor_2d(e_dma_desc_t* desc, const ebsp_dma_item* item) {
+    unsigned index = (((unsigned)item->dst) | ((unsigned)item->src) |
+                      ((unsigned)item->nbytes) | ((unsigned)item->dst_stride) |
+                      ((unsigned)item->src_stride)) &
+                     7;
+    unsigned shift = dma_data_size[index] >> 5;
+    int back = (int)item->nbytes - (1 << shift);
+
+    desc->config =
+        E_DMA_MASTER | E_DMA_ENABLE | E_DMA_IRQEN | dma_data_size[index];
+    if ((((unsigned)item->dst) & local_mask) == 0)
+        desc->config |= E_DMA_MSGMODE;
+    desc->inner_stride = 0x00010001 << shift;
+    desc->count = (item->rows << 16) | (item->nbytes >> shift);
+    desc->outer_stride = (((unsigned)(item->dst_stride - back)) << 16) |
+                         (((unsigned)(item->src_stride - back)) & 0xffff);
+    desc->src_addr = (void*)item->src;
+    desc->dst_addr = item->dst;
+}
+
+// Every DMA channel has its own queue of descriptors (see ebsp_dma_queue).
+// Descriptors are kept in a linked list, using the `next` field in the
+// upper 16 bits of the config word. The DMA engine works on one *batch* at a
+// time: a hardware chain from `cur` to `batch_last`, where all
+// descriptors except the last have E_DMA_CHAIN set, and only the last one
+// has E_DMA_IRQEN set. The engine walks the batch on its own, so there is
+// one interrupt per batch instead of one per descriptor.
+//
+// Descriptors that are pushed while a batch is running are linked behind it
+// and they form the next batch, which is started by the interrupt. Only the
+// `next` field of the last descriptor of the running batch is changed for
+// this. Its E_DMA_CHAIN and E_DMA_IRQEN bits are left alone, because the
+// engine might have loaded that descriptor already.
+//
+// A descriptor is marked as finished by clearing its E_DMA_ENABLE bit in
+// memory. The interrupt does this for the whole batch. ebsp_dma_wait uses
+// the DMA status registers to mark descriptors inside a running batch.
+// Since the handle itself carries this bit, waiting does not depend on the
+// channel that the task was pushed to.
+//
+// The descriptors that wait for the running batch are not touched by the
+// engine yet, so they can be reordered. They are kept sorted by priority,
+// highest first, and a descriptor is placed behind the waiting descriptors
+// with the same or a higher priority. Streams use this to let a transfer
+// that the core is waiting for go before prefetches and outgoing data.
+
+// Inserts the descriptors `first` up to `last`, which are already linked
+// and chained together, into the queue with priority
+// 0 <= priority < DMA_PRIORITY_LEVELS.
+void _dma_enqueue_priority(ebsp_dma_queue* queue, e_dma_desc_t* first,
+                           e_dma_desc_t* last, int priority) {
+    // The interrupt changes the list, so it has to be disabled
+    e_irq_global_mask(E_TRUE);
+
+    if (queue->cur == 0) {
+        // The engine is idle, so this is a batch of its own
+        queue->cur = first;
+        queue->batch_last = last;
+        queue->last = last;
+
+        // Start the DMA engine using the kickstart bit
+        unsigned kickstart = ((unsigned)first << 16) | E_DMA_STARTUP;
+        *queue->config = kickstart;
+    } else {
+        // Find the descriptor to insert behind: the last waiting descriptor
+        // with at least this priority, or the end of the running batch
+        e_dma_desc_t* prev = queue->batch_last;
+        for (int i = priority; i < DMA_PRIORITY_LEVELS; i++) {
+            if (queue->level_last[i] != 0) {
+                prev = queue->level_last[i];
+                break;
+            }
+        }
+
+        if (prev == queue->last) {
+            // Nothing waits behind prev, so `last` ends the list
+            queue->last = last;
+        } else {
+            // Chain `last` to the descriptor that was behind prev
+            unsigned next = prev->config & 0xffff0000;
+            last->config =
+                (last->config & 0x0000ffff & ~E_DMA_IRQEN) | E_DMA_CHAIN | next;
+        }
+
+        // Link prev to `first`. If prev is not part of the running batch,
+        // it is chained to `first` and the interrupt moves to the end.
+        unsigned newconfig = (prev->config & 0x0000ffff) | ((unsigned)first << 16);
+        if (prev != queue->batch_last)
+            newconfig = (newconfig | E_DMA_CHAIN) & ~E_DMA_IRQEN;
+        prev->config = newconfig;
+        queue->level_last[priority] = last;
+    }
+
+    e_irq_global_mask(E_FALSE);
+}
+
+// Appends the descriptors `first` up to `last` to the queue
+void _dma_enqueue(ebsp_dma_queue* queue, e_dma_desc_t* first,
+                  e_dma_desc_t* last) {
+    _dma_enqueue_priority(queue, first, last, 0);
+}
+
+// Returns the index of the DMA channel to use for a transfer to `dst`
+int _dma_select_channel(void* dst, ebsp_dma_channel channel) {
+    if (channel == EBSP_DMA_CHANNEL0)
+        return 0;
+    if (channel == EBSP_DMA_CHANNEL1)
+        return 1;
+
+    // Reads into local memory (typically from external memory) go to
+    // DMA1 and writes to other cores or external memory go to DMA0, so
+    // that prefetching does not wait for outgoing data or vice versa.
+    // When the preferred channel is busy but the other one is idle,
+    // the idle one is used instead.
+    int index = ((((unsigned)dst) & local_mask) == 0) ? 1 : 0;
+    if (coredata.dma[index].cur != 0 && coredata.dma[index ^ 1].cur == 0)
+        index ^= 1;
+    return index;
+}
+
 void ebsp_dma_push(ebsp_dma_handle* descriptor, void* dst, const void* src,
                    size_t nbytes) {
     if (nbytes == 0)
@@ -53,89 +177,217 @@ void ebsp_dma_push(ebsp_dma_handle* descriptor, void* dst, const void* src,
     // Set the contents of the descriptor
     _prepare_descriptor(desc, dst, src, nbytes);
 
-    // Take the end of the current descriptor chain
-    e_dma_desc_t* last = coredata.last_dma_desc;
-
-    if (last == NULL) {
-        // No current chain, replace it by this one
-        coredata.last_dma_desc = desc;
-    } else if (last != desc) {
-        // We need to disable interrupts because
-        // if the interrupt fires between `newconfig = ...`
-        // and `last->config = ...` then the interrupt
-        // clears the E_DMA_ENABLE bit but it is then set again
-        // by this code below, which is not what we want
-        e_irq_global_mask(E_TRUE);
-        // Attach desc to last
-        unsigned newconfig =
-            (last->config & 0x0000ffff) | ((unsigned)desc << 16);
-        last->config = newconfig;
-        e_irq_global_mask(E_FALSE);
-        coredata.last_dma_desc = desc;
-    }
+    // Plain pushes all go to DMA1 so that they are done in order
+    _dma_enqueue(&coredata.dma[1], desc, desc);
+}
+
+void ebsp_dma_push_channel(ebsp_dma_handle* descriptor, void* dst,
+                           const void* src, size_t nbytes,
+                           ebsp_dma_channel channel) {
+    if (nbytes == 0)
+        return;
+
+    e_dma_desc_t* desc = (e_dma_desc_t*)descriptor;
+
+    // Set the contents of the descriptor
+    _prepare_descriptor(desc, dst, src, nbytes);
+
+    int index = _dma_select_channel(dst, channel);
+    _dma_enqueue(&coredata.dma[index], desc, desc);
+}
 
-    // In principle it could happen that at this point, the previous
-    // DMA task finished, its interrupt fires which starts the DMA
-    // engine for THIS task, which could then ALSO finish.
-    // Therefore we have to check for this inside the if statement below
-
-    // Start DMA if not started yet
-    if (coredata.cur_dma_desc == 0) {
-        if (desc->config & E_DMA_ENABLE) {
-            // Start the DMA engine using the kickstart bit
-            coredata.cur_dma_desc = desc;
-            unsigned kickstart = ((unsigned)desc << 16) | E_DMA_STARTUP;
-            *coredata.dma1config = kickstart;
+void ebsp_dma_push_list(ebsp_dma_handle* handles, const ebsp_dma_item* items,
+                        int count, ebsp_dma_channel channel) {
+    e_dma_desc_t* first = 0;
+    e_dma_desc_t* last = 0;
+
+    // Prepare all descriptors and chain them together, so that the
+    // DMA engine processes the list without intervention of the core
+    for (int i = 0; i < count; i++) {
+        e_dma_desc_t* desc = (e_dma_desc_t*)&handles[i];
+        if (items[i].nbytes == 0) {
+            // Nothing to do, so the task is finished immediately
+            desc->config = 0;
+            continue;
         }
+
+        if (items[i].rows > 1)
+            _prepare_descriptor_2d(desc, &items[i]);
+        else
+            _prepare_descriptor(desc, items[i].dst, items[i].src,
+                                items[i].nbytes);
+
+        if (last == 0) {
+            first = desc;
+        } else {
+            last->config = (last->config & 0x0000ffff & ~E_DMA_IRQEN) |
+                           E_DMA_CHAIN | ((unsigned)desc << 16);
+        }
+        last = desc;
     }
+
+    if (first == 0)
+        return;
+
+    // The whole list goes to a single channel
+    int index = _dma_select_channel(first->dst_addr, channel);
+    _dma_enqueue(&coredata.dma[index], first, last);
 }
 
-void __attribute__((interrupt)) _dma_interrupt() {
-    // If DMA is in chaining mode, an interrupt will be fired after a chain
-    // element is completed. At this point in the interrupt, the DMA will
-    // already be busy doing the next element of the chain or even the one
-    // after that if it fired two interrupts really quickly after each other.
-    //
-    // The DMA should not be used in chaining mode, or the whole method
-    // does not work. It seems like the codeblock below is a solution
-    // but it fails when there are many tiny dma transfers in the chain
-    // and the DMA fires many interrupts that will be lost in obliviion
-    // because this function is still running.
-    // We can not lose any interrupts, because we need to advance the
-    // `cur_dma_desc` pointer at each interrupt, even for chains
-    //
-    // unsigned status = *coredata.dma1status;
-    // if (status & 0xf)
-    //     return;
-
-    // Grab the current task
-    e_dma_desc_t* desc = coredata.cur_dma_desc;
+// Called from the interrupt of a channel, which fires when the last
+// descriptor of a batch is finished.
+static inline __attribute__((always_inline)) void
+_dma_finish_batch(ebsp_dma_queue* queue, unsigned error_flag) {
+    e_dma_desc_t* desc = queue->cur;
     if (desc == 0) { // should not happen
         // We want to show an error message but not using
         // ebsp_message because we are inside an interrupt.
         // Instead we use the following flag that the host reads.
-        combuf->interrupts[coredata.pid] =
-            0x80; // Use (1 << E_DMA1_INT) as error message
+        combuf->interrupts[coredata.pid] = error_flag;
         return;
     }
 
-    // Mark 'desc' as finished
-    desc->config &= ~(E_DMA_ENABLE);
+    // Mark all descriptors in the batch as finished
+    e_dma_desc_t* batch_last = queue->batch_last;
+    for (;;) {
+        desc->config &= ~(E_DMA_ENABLE);
+        if (desc == batch_last)
+            break;
+        desc = (e_dma_desc_t*)(desc->config >> 16);
+    }
 
-    // Go to the 'next' task
-    e_dma_desc_t* next = (e_dma_desc_t*)(desc->config >> 16);
-    coredata.cur_dma_desc = next;
+    // Start the next batch, if any, which is everything
+    // that was pushed while this batch was running
+    e_dma_desc_t* next = (e_dma_desc_t*)(batch_last->config >> 16);
+    queue->cur = next;
+
+    // All waiting descriptors are in the new batch
+    for (int i = 0; i < DMA_PRIORITY_LEVELS; i++)
+        queue->level_last[i] = 0;
 
     if (next) {
+        queue->batch_last = queue->last;
         // Start the DMA engine using the kickstart bit
         unsigned kickstart = ((unsigned)next << 16) | E_DMA_STARTUP;
-        *coredata.dma1config = kickstart;
+        *queue->config = kickstart;
+    } else {
+        queue->batch_last = 0;
+        queue->last = 0;
     }
 }
 
+void __attribute__((interrupt)) _dma0_interrupt() {
+    // Use (1 << E_DMA0_INT) as error message
+    _dma_finish_batch(&coredata.dma[0], 0x40);
+    _skip_idle();
+}
+
+void __attribute__((interrupt)) _dma1_interrupt() {
+    // Use (1 << E_DMA1_INT) as error message
+    _dma_finish_batch(&coredata.dma[1], 0x80);
+    _skip_idle();
+}
+
+// Marks the descriptors of the running batch that the DMA engine has
+// finished, based on the `next` pointer in the DMA status register.
+void _dma_update_progress(ebsp_dma_queue* queue) {
+    e_irq_global_mask(E_TRUE);
+
+    e_dma_desc_t* desc = queue->cur;
+    e_dma_desc_t* batch_last = queue->batch_last;
+    unsigned status = *queue->status;
+
+    // When the engine is idle, the batch is either finished or not started
+    // yet, and the interrupt will take care of it. Otherwise, the engine is
+    // at the descriptor whose `next` pointer is in the status register, and
+    // all descriptors before it are finished. While the engine is starting
+    // or fetching a descriptor, the status register can still hold a
+    // pointer that matches no descriptor of the batch, and then nothing is
+    // marked.
+    if (desc != 0 && (status & 0xf) != 0) {
+        unsigned next = status >> 16;
+
+        e_dma_desc_t* active = desc;
+        while ((active->config >> 16) != next) {
+            if (active == batch_last) {
+                active = 0;
+                break;
+            }
+            active = (e_dma_desc_t*)(active->config >> 16);
+        }
+
+        // The last descriptor is always left for the interrupt
+        if (active != 0) {
+            while (desc != active) {
+                desc->config &= ~(E_DMA_ENABLE);
+                desc = (e_dma_desc_t*)(desc->config >> 16);
+            }
+            queue->cur = desc;
+        }
+    }
+
+    e_irq_global_mask(E_FALSE);
+}
+
 void ebsp_dma_wait(ebsp_dma_handle* descriptor) {
     volatile unsigned* config = &descriptor->config;
     while (*config & E_DMA_ENABLE) {
+        _dma_update_progress(&coredata.dma[0]);
+        _dma_update_progress(&coredata.dma[1]);
+
+        // A descriptor with E_DMA_IRQEN set is the last of its batch, so it
+        // is finished by an interrupt and the core can sleep until then.
+        // Other descriptors are finished by _dma_update_progress only.
+        e_irq_global_mask(E_TRUE);
+        if ((*config & (E_DMA_ENABLE | E_DMA_IRQEN)) ==
+            (E_DMA_ENABLE | E_DMA_IRQEN))
+            _ebsp_sleep();
+        else
+            e_irq_global_mask(E_FALSE);
+    }
+}
+
+int ebsp_dma_test(ebsp_dma_handle* descriptor) {
+    volatile unsigned* config = &descriptor->config;
+    if (*config & E_DMA_ENABLE) {
+        _dma_update_progress(&coredata.dma[0]);
+        _dma_update_progress(&coredata.dma[1]);
     }
+    return (*config & E_DMA_ENABLE) == 0;
+}
+
+void ebsp_dma_wait_all(ebsp_dma_handle* descriptors, int count) {
+    // Tasks on the same channel finish in order, so after waiting for one
+    // task the earlier tasks need no more than a single check
+    for (int i = count - 1; i >= 0; i--)
+        ebsp_dma_wait(&descriptors[i]);
 }
 
+int ebsp_dma_wait_any(ebsp_dma_handle* descriptors, int count) {
+    if (count <= 0)
+        return -1;
+
+    for (;;) {
+        _dma_update_progress(&coredata.dma[0]);
+        _dma_update_progress(&coredata.dma[1]);
+
+        // As in ebsp_dma_wait, the core can only sleep when every pending
+        // task is the last of its batch, so that the first of them to
+        // finish raises an interrupt.
+        e_irq_global_mask(E_TRUE);
+        int can_sleep = 1;
+        for (int i = 0; i < count; i++) {
+            volatile unsigned* config = &descriptors[i].config;
+            if ((*config & E_DMA_ENABLE) == 0) {
+                e_irq_global_mask(E_FALSE);
+                return i;
+            }
+            if ((*config & E_DMA_IRQEN) == 0)
+                can_sleep = 0;
+        }
+        if (can_sleep)
+            _ebsp_sleep();
+        else
+            e_irq_global_mask(E_FALSE);
+    }
+}
@@ -0,0 +1,47 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+// Enables interrupts and puts the core to sleep until an interrupt arrives
+// void _ebsp_sleep()
+//
+// Must be called with interrupts disabled, right after checking the
+// condition to wait for. An interrupt that arrives after the GIE but before
+// the IDLE returns to the IDLE instruction, which would sleep forever.
+// Interrupt handlers that can end a wait therefore call _skip_idle()
+// (see e_bsp_private.h), which moves the return address past the IDLE
+// when it equals _ebsp_idle_instruction.
+
+.file    "e_bsp_idle.s";
+
+.section .text;
+.type    _ebsp_sleep, %function;
+.global  _ebsp_sleep;
+.global  _ebsp_idle_instruction;
+
+.balign 4;
+_ebsp_sleep:
+
+    gie;                            // enable interrupts
+_ebsp_idle_instruction:
+    idle;                           // sleep until an interrupt, 16 bit
+    rts;
+
+.size    _ebsp_sleep, .-_ebsp_sleep;
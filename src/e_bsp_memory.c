@@ -87,33 +87,125 @@ void EXT_MEM_TEXT print_malloc_info() {
                  (unsigned int)used, (unsigned int)free);
 }
 
+// Reads from another core or from external memory that are at least this
+// large are done by the DMA engine. Below this size the time to set up the
+// transfer is larger than the time saved. Writes are always done by the
+// core, because they do not wait for the other side to respond.
+#define MEMCPY_DMA_THRESHOLD 256
+
+// Copies data when `dst` is 8-byte aligned, but `src` is not 4-byte aligned
+// relative to it. Whole words are read from the aligned addresses around
+// `src` and shifted into place, so every word is read only once.
+// Returns the number of bytes that were copied.
+static size_t _memcpy_shifted(uint32_t* dst, const uint8_t* src,
+                              size_t nbytes) {
+    unsigned offset = (unsigned)src & 0x3;
+    unsigned right = offset << 3;
+    unsigned left = 32 - right;
+    const uint32_t* src_w = (const uint32_t*)(src - offset);
+
+    size_t count = nbytes >> 3;
+    uint32_t cur = *src_w++;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t next1 = *src_w++;
+        uint32_t next2 = *src_w++;
+        uint32_t lo = (cur >> right) | (next1 << left);
+        uint32_t hi = (next1 >> right) | (next2 << left);
+        *(uint64_t*)dst = ((uint64_t)hi << 32) | lo;
+        dst += 2;
+        cur = next2;
+    }
+    return count << 3;
+}
+
 void ebsp_memcpy(void* dest, const void* source, size_t nbytes) {
-    unsigned bits = (unsigned)dest | (unsigned)source;
-    if ((bits & 0x7) == 0) {
-        // 8-byte aligned
-        long long* dst = (long long*)dest;
-        const long long* src = (const long long*)source;
-        int count = nbytes >> 3;
-        nbytes &= 0x7;
-        while (count--)
-            *dst++ = *src++;
-        dest = (void*)dst;
-        source = (void*)src;
-    } else if ((bits & 0x3) == 0) {
-        // 4-byte aligned
-        uint32_t* dst = (uint32_t*)dest;
-        const uint32_t* src = (const uint32_t*)source;
-        int count = nbytes >> 2;
-        nbytes &= 0x3;
-        while (count--)
-            *dst++ = *src++;
-        dest = (void*)dst;
-        source = (void*)src;
+    // Large reads into local memory are given to an idle DMA channel. The
+    // DMA engine can not copy from a core to itself, so a source at the
+    // global address of this core is copied by the core.
+    unsigned own_mask = ((unsigned)coredata.coreids[coredata.pid]) << 20;
+    if (nbytes >= MEMCPY_DMA_THRESHOLD &&
+        ((unsigned)dest & local_mask) == 0 &&
+        ((unsigned)source & local_mask) != 0 &&
+        ((unsigned)source & local_mask) != own_mask) {
+        int channel = -1;
+        if (coredata.dma[1].cur == 0)
+            channel = EBSP_DMA_CHANNEL1;
+        else if (coredata.dma[0].cur == 0)
+            channel = EBSP_DMA_CHANNEL0;
+        if (channel != -1) {
+            ebsp_dma_handle handle;
+            ebsp_dma_push_channel(&handle, dest, source, nbytes,
+                                  (ebsp_dma_channel)channel);
+            ebsp_dma_wait(&handle);
+            return;
+        }
     }
 
-    // do remaining bytes 1-byte aligned
     char* dst_b = (char*)dest;
     const char* src_b = (const char*)source;
+
+    if (nbytes >= 16) {
+        unsigned diff = (unsigned)dst_b ^ (unsigned)src_b;
+
+        if ((diff & 0x3) == 0) {
+            // Same alignment within a word: copy bytes until dst is
+            // aligned, then whole (double) words
+            unsigned mask = (diff & 0x4) == 0 ? 0x7 : 0x3;
+            while ((unsigned)dst_b & mask) {
+                *dst_b++ = *src_b++;
+                nbytes--;
+            }
+
+            if (mask == 0x7) {
+                // 8-byte aligned, unrolled
+                long long* dst = (long long*)dst_b;
+                const long long* src = (const long long*)src_b;
+                int count = nbytes >> 5;
+                while (count--) {
+                    long long a = src[0];
+                    long long b = src[1];
+                    long long c = src[2];
+                    long long d = src[3];
+                    dst[0] = a;
+                    dst[1] = b;
+                    dst[2] = c;
+                    dst[3] = d;
+                    dst += 4;
+                    src += 4;
+                }
+                count = (nbytes >> 3) & 0x3;
+                while (count--)
+                    *dst++ = *src++;
+                nbytes &= 0x7;
+                dst_b = (char*)dst;
+                src_b = (const char*)src;
+            } else {
+                // 4-byte aligned
+                uint32_t* dst = (uint32_t*)dst_b;
+                const uint32_t* src = (const uint32_t*)src_b;
+                int count = nbytes >> 2;
+                nbytes &= 0x3;
+                while (count--)
+                    *dst++ = *src++;
+                dst_b = (char*)dst;
+                src_b = (const char*)src;
+            }
+        } else {
+            // Different alignment: copy bytes until dst is 8-byte aligned,
+            // then realign the source with shifts
+            while ((unsigned)dst_b & 0x7) {
+                *dst_b++ = *src_b++;
+                nbytes--;
+            }
+            size_t done = _memcpy_shifted((uint32_t*)dst_b,
+                                          (const uint8_t*)src_b, nbytes);
+            dst_b += done;
+            src_b += done;
+            nbytes -= done;
+        }
+    }
+
+    // do remaining bytes 1-byte aligned
     while (nbytes--)
         *dst_b++ = *src_b++;
 }
@@ -26,6 +26,12 @@ see the files COPYING and COPYING.LESSER. If not, see
 const char err_send_overflow[] EXT_MEM_RO =
     "BSP ERROR: too many bsp_send requests per sync";
 
+const char err_combiner_tagsize[] EXT_MEM_RO =
+    "BSP ERROR: tag size %d is too large to attach a combiner";
+
+const char err_too_many_combiners[] EXT_MEM_RO =
+    "BSP ERROR: too many combiners (maximum is %d)";
+
 int ebsp_get_tagsize() { return coredata.tagsize; }
 
 void EXT_MEM_TEXT bsp_set_tagsize(int* tag_bytes) {
@@ -34,6 +40,57 @@ void EXT_MEM_TEXT bsp_set_tagsize(int* tag_bytes) {
     *tag_bytes = coredata.tagsize;
 }
 
+// Returns the index of the combiner attached to this tag, or -1 if none
+static int EXT_MEM_TEXT _find_combiner(const void* tag, unsigned tagsize) {
+    for (int i = 0; i < coredata.ncombiners; i++) {
+        if (coredata.combiner_tagsize[i] != tagsize)
+            continue;
+        const uint8_t* a = coredata.combiner_tags[i];
+        const uint8_t* b = tag;
+        int j = 0;
+        while (j < tagsize && a[j] == b[j])
+            j++;
+        if (j == tagsize)
+            return i;
+    }
+    return -1;
+}
+
+void EXT_MEM_TEXT ebsp_set_combiner(const void* tag, ebsp_combiner combiner) {
+    unsigned tagsize = coredata.tagsize;
+    if (tagsize > MAX_COMBINER_TAGSIZE) {
+        ebsp_message(err_combiner_tagsize, tagsize);
+        return;
+    }
+
+    int i = _find_combiner(tag, tagsize);
+    if (i == -1) {
+        if (combiner == 0)
+            return;
+        if (coredata.ncombiners == MAX_COMBINERS) {
+            ebsp_message(err_too_many_combiners, MAX_COMBINERS);
+            return;
+        }
+        i = coredata.ncombiners++;
+        coredata.combiner_tagsize[i] = tagsize;
+        ebsp_memcpy(coredata.combiner_tags[i], tag, tagsize);
+    } else if (combiner == 0) {
+        // Move the last combiner into the free slot
+        int last = --coredata.ncombiners;
+        coredata.combiners[i] = coredata.combiners[last];
+        coredata.combiner_tagsize[i] = coredata.combiner_tagsize[last];
+        ebsp_memcpy(coredata.combiner_tags[i], coredata.combiner_tags[last],
+                    MAX_COMBINER_TAGSIZE);
+        i = last;
+    }
+    coredata.combiners[i] = combiner;
+
+    // Messages that are already queued stay as they are, but nothing
+    // will be folded into them anymore
+    for (int j = 0; j < MAX_COMBINERS; j++)
+        coredata.combined_superstep[j] = coredata.superstep - 1;
+}
+
 void EXT_MEM_TEXT
 bsp_send(int pid, const void* tag, const void* payload, int nbytes) {
     unsigned int index;
@@ -43,6 +100,25 @@ bsp_send(int pid, const void* tag, const void* payload, int nbytes) {
     ebsp_message_queue* q =
         &combuf->message_queue[coredata.read_queue_index ^ 1];
 
+    // Fold the payload into an earlier message if this tag has a combiner
+    int combiner = -1;
+    if (coredata.ncombiners && pid >= 0 && pid < NPROCS)
+        combiner = _find_combiner(tag, coredata.tagsize);
+    if (combiner != -1) {
+        uint16_t* pending = coredata.combined_message[combiner];
+        if (coredata.combined_superstep[combiner] != coredata.superstep) {
+            coredata.combined_superstep[combiner] = coredata.superstep;
+            for (int i = 0; i < NPROCS; i++)
+                pending[i] = 0;
+        } else if (pending[pid] != 0) {
+            ebsp_message_header* m = &q->message[pending[pid] - 1];
+            if (m->nbytes == nbytes) {
+                coredata.combiners[combiner](m->payload, payload, nbytes);
+                return;
+            }
+        }
+    }
+
     e_mutex_lock(0, 0, &coredata.payload_mutex);
 
     index = q->count;
@@ -74,6 +150,9 @@ bsp_send(int pid, const void* tag, const void* payload, int nbytes) {
 
     ebsp_memcpy(tag_ptr, tag, coredata.tagsize);
     ebsp_memcpy(payload_ptr, payload, nbytes);
+
+    if (combiner != -1)
+        coredata.combined_message[combiner][pid] = index + 1;
 }
 
 // Gets the next message from the queue, does not pop
@@ -53,9 +53,8 @@ int bsp_init(const char* _e_name, int argc, char** argv) {
         return 0;
     }
 
-#ifdef DEBUG
+    // Read the symbol table, used for accessing variables by name
     _read_elf(state.e_fullpath);
-#endif
 
     // Initialize the Epiphany system for the working with the host application
     if (e_init(NULL) != E_OK) {
@@ -176,8 +175,12 @@ int ebsp_spmd() {
         void* stream_descriptors = ebsp_ext_malloc(nbytes);
         memcpy(stream_descriptors, state.shared_streams, nbytes);
         state.combuf.streams = _arm_to_e_pointer(stream_descriptors);
+        state.stream_descriptors = stream_descriptors;
     }
 
+    // Fill the streams that are backed by the host before the cores start
+    _host_streams_service();
+
     // Write communication buffer containing nprocs,
     // messages and tagsize
     state.combuf.nprocs = state.nprocs_used;
@@ -188,6 +191,8 @@ int ebsp_spmd() {
         return 0;
     }
 
+    state.spmd_running = 1;
+
     // Starting time
     clock_gettime(CLOCK_MONOTONIC, &state.ts_start);
     _update_remote_timer();
@@ -254,6 +259,8 @@ int ebsp_spmd() {
         _update_remote_timer();
         _microsleep(1); // 1000 is 1 millisecond
 
+        _host_streams_service();
+
         // Read the first part of the communication buffer
         // that contains sync states: read all up till coredata (not inclusive)
         if (e_read(&state.emem, 0, 0, 0, &state.combuf, read_size) !=
@@ -383,6 +390,10 @@ int ebsp_spmd() {
         if (finish_counter == state.nprocs_used)
             break;
     }
+
+    // Tokens that were moved up at the end of the program
+    _host_streams_finish();
+    state.spmd_running = 0;
     // Read the communication buffer
     // to get final messages from the program
     if (e_read(&state.emem, 0, 0, 0, &state.combuf, sizeof(ebsp_combuf)) !=
@@ -414,11 +425,9 @@ int bsp_end() {
         return 0;
     }
 
-#ifdef DEBUG
     if (state.e_symbols)
         free(state.e_symbols);
     state.e_symbols = 0;
-#endif
 
     if (bsp_initialized >= 2)
         e_free(&state.emem);
@@ -23,14 +23,15 @@ see the files COPYING and COPYING.LESSER. If not, see
 #include "host_bsp_private.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
 extern bsp_state_t state;
 #define MINIMUM_CHUNK_SIZE (4 * sizeof(int))
 
-void* bsp_stream_create(int stream_size, int token_size,
-                         const void* initial_data) {
+void* _stream_create(int stream_size, int token_size,
+                     const void* initial_data, int indexed) {
     if (token_size < MINIMUM_CHUNK_SIZE) {
         printf("ERROR: minimum token size is %i bytes\n", MINIMUM_CHUNK_SIZE);
         return 0;
@@ -55,6 +56,21 @@ void* bsp_stream_create(int stream_size, int token_size,
         return 0;
     }
 
+    // The token index holds the offset of every token and of the terminating
+    // header. Tokens moved up by a core are at least 8 bytes plus a header,
+    // also when they overwrite the initial data after a seek, so the
+    // buffer never holds more than this many tokens.
+    unsigned* token_index = NULL;
+    if (indexed) {
+        int capacity = nbytes_including_headers / (2 * sizeof(int) + 8) + 1;
+        token_index = ebsp_ext_malloc(capacity * sizeof(unsigned));
+        if (token_index == 0) {
+            printf("ERROR: not enough memory in extmem for the token index\n");
+            ebsp_free(extmem_buffer);
+            return 0;
+        }
+    }
+
     // 2) copy the data to extmem, inserting headers
     unsigned dst_cursor = (unsigned)extmem_buffer;
     unsigned src_cursor = (unsigned)initial_data;
@@ -67,6 +83,9 @@ void* bsp_stream_create(int stream_size, int token_size,
             if (nbytes_left < token_size)
                 current_chunksize = nbytes_left;
 
+            if (token_index)
+                *token_index++ = dst_cursor - (unsigned)extmem_buffer;
+
             (*(int*)dst_cursor) = last_chunksize; // write prev header
             dst_cursor += sizeof(int);
             (*(int*)dst_cursor) = current_chunksize; // write next header
@@ -80,12 +99,16 @@ void* bsp_stream_create(int stream_size, int token_size,
             last_chunksize = current_chunksize;
         }
         // Write a terminating header
+        if (token_index)
+            *token_index = dst_cursor - (unsigned)extmem_buffer;
         (*(int*)dst_cursor) = current_chunksize; // write terminating header (prev)
         dst_cursor += sizeof(int);
         (*(int*)dst_cursor) = 0; // write terminating header (next)
         dst_cursor += sizeof(int);
     } else {
         // Write a single terminating header, or upstreams will crash
+        if (token_index)
+            *token_index = 0;
         (*(int*)dst_cursor) = 0; // prevsize
         dst_cursor += sizeof(int);
         (*(int*)dst_cursor) = 0; // nextsize
@@ -97,15 +120,696 @@ void* bsp_stream_create(int stream_size, int token_size,
 
     x.extmem_addr = _arm_to_e_pointer(extmem_buffer);
     x.cursor = x.extmem_addr;
+    x.position = 0;
     x.nbytes = nbytes_including_headers;
     x.max_chunksize = token_size;
     x.pid = -1;
     memset(&x.e_dma_desc, 0, sizeof(ebsp_dma_handle));
     x.current_buffer = NULL;
     x.next_buffer = NULL;
+    // All tokens have size token_size, except possibly the last one
+    x.ntokens = initial_data ? ntokens : 0;
+    x.token_index = NULL;
+    x.raw = 0;
+    x.shared = 0;
+    x.claim = -1;
+    x.requeue = NULL;
+    x.nrequeued = 0;
+    x.encoding = ENCODING_NONE;
+    x.max_encoded = 0;
+    x.pipe_end = PIPE_NONE;
+    x.pipe_peer = -1;
+    x.pipe_count = 0;
+    x.pipe_closed = 0;
+    x.published = 0;
+    if (indexed) {
+        token_index -= initial_data ? ntokens : 0;
+        x.token_index = _arm_to_e_pointer(token_index);
+    }
+
+    state.shared_streams[state.combuf.nstreams] = x;
+    state.combuf.nstreams++;
+
+    return extmem_buffer;
+}
+
+void* bsp_stream_create(int stream_size, int token_size,
+                        const void* initial_data) {
+    return _stream_create(stream_size, token_size, initial_data, 0);
+}
+
+void* bsp_stream_create_indexed(int stream_size, int token_size,
+                                const void* initial_data) {
+    return _stream_create(stream_size, token_size, initial_data, 1);
+}
+
+void* bsp_stream_create_shared(int stream_size, int token_size,
+                               const void* initial_data) {
+    if (initial_data == 0) {
+        printf("ERROR: a shared stream needs initial data\n");
+        return 0;
+    }
+    void* extmem_buffer = _stream_create(stream_size, token_size, initial_data, 0);
+    if (extmem_buffer == 0)
+        return 0;
+
+    // The stream is not owned by a core, so every core can open it
+    state.shared_streams[state.combuf.nstreams - 1].shared = 1;
+
+    return extmem_buffer;
+}
+
+void* bsp_stream_create_distributed(int stream_size, int token_size,
+                                    const void* initial_data) {
+    void* extmem_buffer =
+        bsp_stream_create_shared(stream_size, token_size, initial_data);
+    if (extmem_buffer == 0)
+        return 0;
+
+    // Cores claim tokens starting from the first one. Tokens that a core
+    // has claimed but gives back are kept in a list, which is never longer
+    // than the number of tokens.
+    ebsp_stream_descriptor* x = &state.shared_streams[state.combuf.nstreams - 1];
+    void* requeue = ebsp_ext_malloc(x->ntokens * sizeof(int32_t));
+    if (requeue == 0) {
+        printf("ERROR: not enough memory in extmem for "
+               "bsp_stream_create_distributed\n");
+        ebsp_free(extmem_buffer);
+        state.combuf.nstreams--;
+        return 0;
+    }
+    x->claim = 0;
+    x->requeue = _arm_to_e_pointer(requeue);
+
+    return extmem_buffer;
+}
+
+// Writes an unsigned LEB128 varint, and returns the number of bytes
+int _write_varint(uint8_t* dst, uint32_t value) {
+    int n = 0;
+    while (value >= 0x80) {
+        dst[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    dst[n++] = value;
+    return n;
+}
+
+// Encodes a token, and returns the size of the encoded token rounded up to
+// a multiple of 4. The encoded token starts with the size of the token,
+// followed by the data in the format of the encoding.
+// The decoding is done by _ebsp_decode in e_bsp_buffer.c
+int _encode_token(ebsp_encoding encoding, uint8_t* dst, const int32_t* src,
+                  int nbytes) {
+    int nwords = nbytes / sizeof(int32_t);
+    int n = sizeof(int32_t);
+    *(int32_t*)dst = nbytes;
+
+    switch (encoding) {
+    case EBSP_ENCODING_DELTA_VARINT: {
+        // Differences with the previous word, zigzag encoded so that
+        // small negative differences are small as well
+        uint32_t prev = 0;
+        for (int i = 0; i < nwords; i++) {
+            uint32_t delta = (uint32_t)src[i] - prev;
+            prev = src[i];
+            n += _write_varint(dst + n, (delta << 1) ^ -(delta >> 31));
+        }
+        break;
+    }
+    case EBSP_ENCODING_RLE:
+        // Runs of equal words, as the length of the run and the word
+        for (int i = 0; i < nwords;) {
+            int j = i;
+            while (j < nwords && src[j] == src[i])
+                j++;
+            n += _write_varint(dst + n, j - i);
+            memcpy(dst + n, &src[i], sizeof(int32_t));
+            n += sizeof(int32_t);
+            i = j;
+        }
+        break;
+    case EBSP_ENCODING_BITPACK: {
+        // The minimum, the number of bits, and the differences with the
+        // minimum packed in words
+        int32_t min = src[0];
+        int32_t max = src[0];
+        for (int i = 1; i < nwords; i++) {
+            if (src[i] < min)
+                min = src[i];
+            if (src[i] > max)
+                max = src[i];
+        }
+        unsigned bits = 0;
+        uint32_t range = (uint32_t)max - (uint32_t)min;
+        while (bits < 32 && (range >> bits) != 0)
+            bits++;
+
+        uint32_t* words = (uint32_t*)dst;
+        uint32_t* packed = words + 3;
+        int npacked = (nwords * bits + 31) / 32;
+        words[1] = min;
+        words[2] = bits;
+        memset(packed, 0, npacked * sizeof(uint32_t));
+        for (int i = 0; i < nwords; i++) {
+            uint32_t value = (uint32_t)src[i] - (uint32_t)min;
+            unsigned offset = i * bits;
+            unsigned shift = offset % 32;
+            packed[offset / 32] |= value << shift;
+            if (shift + bits > 32)
+                packed[offset / 32 + 1] |= value >> (32 - shift);
+        }
+        n = (3 + npacked) * sizeof(uint32_t);
+        break;
+    }
+    default:
+        memcpy(dst + n, src, nbytes);
+        n += nbytes;
+        break;
+    }
+
+    return (n + 3) & ~3;
+}
+
+void* bsp_stream_create_encoded(int stream_size, int token_size,
+                                const void* initial_data,
+                                ebsp_encoding encoding) {
+    if (encoding == EBSP_ENCODING_NONE)
+        return bsp_stream_create(stream_size, token_size, initial_data);
+
+    if (initial_data == 0) {
+        printf("ERROR: an encoded stream needs initial data\n");
+        return 0;
+    }
+    if (token_size < MINIMUM_CHUNK_SIZE) {
+        printf("ERROR: minimum token size is %i bytes\n", MINIMUM_CHUNK_SIZE);
+        return 0;
+    }
+    if (token_size % sizeof(int32_t) != 0 ||
+        stream_size % sizeof(int32_t) != 0) {
+        printf("ERROR: sizes of an encoded stream must be a multiple of 4\n");
+        return 0;
+    }
+    if (state.combuf.nstreams == MAX_N_STREAMS) {
+        printf("ERROR: Reached limit of %d streams.\n", MAX_N_STREAMS);
+        return 0;
+    }
+
+    int ntokens = (stream_size + token_size - 1) / token_size;
+
+    // Encode all tokens. After the size of the token, delta encoding takes
+    // at most 5 bytes for every word, and so does run length encoding
+    // without runs (a 1-byte run length and the word). Bit packing takes
+    // at most 4 bytes for every word and a header of 8 bytes. The extra
+    // word also covers the rounding up to a multiple of 4.
+    int max_token_encoded = 3 * sizeof(int32_t) + (token_size / 4) * 5;
+    uint8_t* encoded = malloc(ntokens * max_token_encoded);
+    int* encoded_sizes = malloc(ntokens * sizeof(int));
+    if (encoded == 0 || encoded_sizes == 0) {
+        printf("ERROR: could not allocate memory to encode stream\n");
+        free(encoded);
+        free(encoded_sizes);
+        return 0;
+    }
+
+    int max_encoded = 0;
+    int nbytes_including_headers = 2 * sizeof(int); // terminating header
+    for (int t = 0; t < ntokens; t++) {
+        int nbytes = (t == ntokens - 1) ? stream_size - t * token_size
+                                        : token_size;
+        encoded_sizes[t] = _encode_token(
+            encoding, encoded + t * max_token_encoded,
+            (const int32_t*)((const uint8_t*)initial_data + t * token_size),
+            nbytes);
+        if (encoded_sizes[t] > max_encoded)
+            max_encoded = encoded_sizes[t];
+        nbytes_including_headers += 2 * sizeof(int) + encoded_sizes[t];
+    }
+
+    void* extmem_buffer = ebsp_ext_malloc(nbytes_including_headers);
+    // The encoded tokens have different sizes, so the stream gets an
+    // index to keep seeking fast
+    unsigned* token_index = ebsp_ext_malloc((ntokens + 1) * sizeof(unsigned));
+    if (extmem_buffer == 0 || token_index == 0) {
+        printf("ERROR: not enough memory in extmem for "
+               "bsp_stream_create_encoded\n");
+        if (extmem_buffer)
+            ebsp_free(extmem_buffer);
+        if (token_index)
+            ebsp_free(token_index);
+        free(encoded);
+        free(encoded_sizes);
+        return 0;
+    }
+
+    // Write the encoded tokens with headers, as in _stream_create
+    uint8_t* dst_cursor = extmem_buffer;
+    int last_chunksize = 0;
+    for (int t = 0; t < ntokens; t++) {
+        token_index[t] = dst_cursor - (uint8_t*)extmem_buffer;
+        ((int*)dst_cursor)[0] = last_chunksize;
+        ((int*)dst_cursor)[1] = encoded_sizes[t];
+        dst_cursor += 2 * sizeof(int);
+        memcpy(dst_cursor, encoded + t * max_token_encoded, encoded_sizes[t]);
+        dst_cursor += encoded_sizes[t];
+        last_chunksize = encoded_sizes[t];
+    }
+    token_index[ntokens] = dst_cursor - (uint8_t*)extmem_buffer;
+    ((int*)dst_cursor)[0] = last_chunksize;
+    ((int*)dst_cursor)[1] = 0;
+
+    free(encoded);
+    free(encoded_sizes);
+
+    ebsp_stream_descriptor x;
+
+    x.extmem_addr = _arm_to_e_pointer(extmem_buffer);
+    x.cursor = x.extmem_addr;
+    x.position = 0;
+    x.nbytes = nbytes_including_headers;
+    x.max_chunksize = token_size;
+    x.pid = -1;
+    memset(&x.e_dma_desc, 0, sizeof(ebsp_dma_handle));
+    x.current_buffer = NULL;
+    x.next_buffer = NULL;
+    x.ntokens = ntokens;
+    x.token_index = _arm_to_e_pointer(token_index);
+    x.raw = 0;
+    x.shared = 0;
+    x.claim = -1;
+    x.requeue = NULL;
+    x.nrequeued = 0;
+    x.encoding = encoding;
+    x.max_encoded = max_encoded;
+    x.pipe_end = PIPE_NONE;
+    x.pipe_peer = -1;
+    x.pipe_count = 0;
+    x.pipe_closed = 0;
+    x.published = 0;
+
+    state.shared_streams[state.combuf.nstreams] = x;
+    state.combuf.nstreams++;
+
+    return extmem_buffer;
+}
+
+void* bsp_stream_create_raw(int stream_size, int token_size,
+                            const void* initial_data) {
+    if (token_size <= 0 || stream_size <= 0) {
+        printf("ERROR: invalid size for raw stream\n");
+        return 0;
+    }
+    if (state.combuf.nstreams == MAX_N_STREAMS) {
+        printf("ERROR: Reached limit of %d streams.\n", MAX_N_STREAMS);
+        return 0;
+    }
+
+    // Data that is in external memory already is used in place
+    void* extmem_buffer;
+    if ((char*)initial_data >= (char*)state.host_dynmem_addr &&
+        (char*)initial_data < (char*)state.host_dynmem_addr + DYNMEM_SIZE) {
+        extmem_buffer = (void*)initial_data;
+    } else {
+        extmem_buffer = ebsp_ext_malloc(stream_size);
+        if (extmem_buffer == 0) {
+            printf("ERROR: not enough memory in extmem for "
+                   "bsp_stream_create_raw\n");
+            return 0;
+        }
+        if (initial_data)
+            memcpy(extmem_buffer, initial_data, stream_size);
+    }
+
+    ebsp_stream_descriptor x;
+
+    x.extmem_addr = _arm_to_e_pointer(extmem_buffer);
+    x.cursor = x.extmem_addr;
+    x.position = 0;
+    x.nbytes = stream_size;
+    x.max_chunksize = token_size;
+    x.pid = -1;
+    memset(&x.e_dma_desc, 0, sizeof(ebsp_dma_handle));
+    x.current_buffer = NULL;
+    x.next_buffer = NULL;
+    x.ntokens = (stream_size + token_size - 1) / token_size;
+    x.token_index = NULL;
+    x.raw = 1;
+    x.shared = 0;
+    x.claim = -1;
+    x.requeue = NULL;
+    x.nrequeued = 0;
+    x.encoding = ENCODING_NONE;
+    x.max_encoded = 0;
+    x.pipe_end = PIPE_NONE;
+    x.pipe_peer = -1;
+    x.pipe_count = 0;
+    x.pipe_closed = 0;
+    x.published = 0;
 
     state.shared_streams[state.combuf.nstreams] = x;
     state.combuf.nstreams++;
 
     return extmem_buffer;
 }
+
+// Creates the two ends of a pipe, the end `first_end` first
+void* _pipe_create(int nslots, int token_size, int first_end) {
+    if (nslots <= 0 || token_size <= 0) {
+        printf("ERROR: invalid size for pipe\n");
+        return 0;
+    }
+    if (state.combuf.nstreams + 2 > MAX_N_STREAMS) {
+        printf("ERROR: Reached limit of %d streams.\n", MAX_N_STREAMS);
+        return 0;
+    }
+
+    // Every slot of the ring holds a header and a token, rounded up
+    // to a multiple of 8 as for tokens that are moved up
+    int slot_size = 2 * sizeof(int) + ((token_size + 8 - 1) / 8) * 8;
+    void* extmem_buffer = ebsp_ext_malloc(nslots * slot_size);
+    if (extmem_buffer == 0) {
+        printf("ERROR: not enough memory in extmem for "
+               "bsp_stream_create_pipe\n");
+        return 0;
+    }
+
+    ebsp_stream_descriptor x;
+
+    x.extmem_addr = _arm_to_e_pointer(extmem_buffer);
+    x.cursor = x.extmem_addr;
+    x.position = 0;
+    x.nbytes = nslots * slot_size;
+    x.max_chunksize = token_size;
+    x.pid = -1;
+    memset(&x.e_dma_desc, 0, sizeof(ebsp_dma_handle));
+    x.current_buffer = NULL;
+    x.next_buffer = NULL;
+    x.ntokens = 0;
+    x.token_index = NULL;
+    x.raw = 0;
+    x.shared = 0;
+    x.claim = -1;
+    x.requeue = NULL;
+    x.nrequeued = 0;
+    x.encoding = ENCODING_NONE;
+    x.max_encoded = 0;
+    x.pipe_count = 0;
+    x.pipe_closed = 0;
+    x.published = 0;
+
+    int id = state.combuf.nstreams;
+    x.pipe_end = first_end;
+    x.pipe_peer = id + 1;
+    state.shared_streams[id] = x;
+    x.pipe_end = (first_end == PIPE_WRITE_END) ? PIPE_READ_END : PIPE_WRITE_END;
+    x.pipe_peer = id;
+    state.shared_streams[id + 1] = x;
+    state.combuf.nstreams += 2;
+
+    return extmem_buffer;
+}
+
+void* bsp_stream_create_pipe(int nslots, int token_size) {
+    // The write end is followed by the read end
+    return _pipe_create(nslots, token_size, PIPE_WRITE_END);
+}
+
+// Streams that are backed by the host are pipes of which the host serves
+// the second end, which is not opened by any core. The host fills or empties
+// the ring from the polling loop in ebsp_spmd(), see _host_streams_service.
+
+void* _host_stream_create(int nslots, int token_size, int is_source,
+                          ebsp_stream_source source, ebsp_stream_sink sink,
+                          void* user_data) {
+    if (state.num_host_streams == MAX_HOST_STREAMS) {
+        printf("ERROR: Reached limit of %d host streams.\n", MAX_HOST_STREAMS);
+        return 0;
+    }
+
+    // The core reads from a source and writes to a sink
+    int id = state.combuf.nstreams;
+    void* extmem_buffer = _pipe_create(
+        nslots, token_size, is_source ? PIPE_READ_END : PIPE_WRITE_END);
+    if (extmem_buffer == 0)
+        return 0;
+
+    ebsp_host_stream* h = &state.host_streams[state.num_host_streams++];
+    h->id = id;
+    h->is_source = is_source;
+    h->source = source;
+    h->sink = sink;
+    h->user_data = user_data;
+    h->ring = extmem_buffer;
+    h->nslots = nslots;
+    h->slot_size = state.shared_streams[id].nbytes / nslots;
+    h->token_size = token_size;
+    h->count = 0;
+    h->done = 0;
+
+    return extmem_buffer;
+}
+
+void* bsp_stream_create_source(int nslots, int token_size,
+                               ebsp_stream_source source, void* user_data) {
+    if (source == 0) {
+        printf("ERROR: a source stream needs a source function\n");
+        return 0;
+    }
+    return _host_stream_create(nslots, token_size, 1, source, 0, user_data);
+}
+
+void* bsp_stream_create_sink(int nslots, int token_size, ebsp_stream_sink sink,
+                             void* user_data) {
+    if (sink == 0) {
+        printf("ERROR: a sink stream needs a sink function\n");
+        return 0;
+    }
+    return _host_stream_create(nslots, token_size, 0, 0, sink, user_data);
+}
+
+int _file_source(void* file, void* token, int max_size) {
+    return fread(token, 1, max_size, (FILE*)file);
+}
+
+void _file_sink(void* file, const void* token, int size) {
+    if (fwrite(token, 1, size, (FILE*)file) != (size_t)size)
+        printf("ERROR: could not write token of file sink\n");
+}
+
+void* bsp_stream_create_file_source(FILE* file, int nslots, int token_size) {
+    if (file == 0) {
+        printf("ERROR: no file for file source\n");
+        return 0;
+    }
+    return bsp_stream_create_source(nslots, token_size, _file_source, file);
+}
+
+void* bsp_stream_create_file_sink(FILE* file, int nslots, int token_size) {
+    if (file == 0) {
+        printf("ERROR: no file for file sink\n");
+        return 0;
+    }
+    return bsp_stream_create_sink(nslots, token_size, _file_sink, file);
+}
+
+// Called before the cores start, in the polling loop and after the cores
+// have finished. The counts are published after the tokens themselves.
+void _host_streams_service() {
+    for (int i = 0; i < state.num_host_streams; i++) {
+        ebsp_host_stream* h = &state.host_streams[i];
+        volatile ebsp_stream_descriptor* core_end =
+            &state.stream_descriptors[h->id];
+        volatile ebsp_stream_descriptor* host_end =
+            &state.stream_descriptors[h->id + 1];
+
+        if (h->is_source) {
+            // Fill every slot that the core has read
+            while (!h->done && h->count - core_end->pipe_count < h->nslots) {
+                int* header =
+                    (int*)((char*)h->ring + (h->count % h->nslots) * h->slot_size);
+                int size = h->source(h->user_data, header + 2, h->token_size);
+                if (size <= 0) {
+                    h->done = 1;
+                    __sync_synchronize();
+                    host_end->pipe_closed = 1;
+                    break;
+                }
+                if (size > h->token_size)
+                    size = h->token_size;
+                header[0] = 0;
+                header[1] = size;
+                __sync_synchronize();
+                h->count++;
+                host_end->pipe_count = h->count;
+            }
+        } else {
+            // Empty every slot that the core has written
+            int written = core_end->pipe_count;
+            __sync_synchronize();
+            while (h->count < written) {
+                int* header =
+                    (int*)((char*)h->ring + (h->count % h->nslots) * h->slot_size);
+                h->sink(h->user_data, header + 2, header[1]);
+                h->count++;
+                host_end->pipe_count = h->count;
+            }
+        }
+    }
+}
+
+// Keeps the state of host streams for the next call to ebsp_spmd()
+void _host_streams_finish() {
+    _host_streams_service();
+    for (int i = 0; i < state.num_host_streams; i++) {
+        ebsp_host_stream* h = &state.host_streams[i];
+        ebsp_stream_descriptor* core_end = &state.shared_streams[h->id];
+        ebsp_stream_descriptor* host_end = &state.shared_streams[h->id + 1];
+        core_end->cursor = state.stream_descriptors[h->id].cursor;
+        core_end->position = state.stream_descriptors[h->id].position;
+        core_end->pipe_count = state.stream_descriptors[h->id].pipe_count;
+        host_end->pipe_count = h->count;
+        host_end->pipe_closed = h->done;
+    }
+}
+
+void* bsp_stream_create_tiled(int rows, int cols, int element_size,
+                              const void* matrix, ebsp_matrix_order layout,
+                              int tile_rows, int tile_cols,
+                              ebsp_matrix_order tile_order, int repeat) {
+    if (rows <= 0 || cols <= 0 || element_size <= 0 || tile_rows <= 0 ||
+        tile_cols <= 0 || repeat <= 0) {
+        printf("ERROR: invalid size for tiled stream\n");
+        return 0;
+    }
+    if (matrix == 0) {
+        printf("ERROR: a tiled stream needs a matrix\n");
+        return 0;
+    }
+
+    // Number of tiles in a column and in a row of tiles, rounded up
+    int tiles_down = (rows + tile_rows - 1) / tile_rows;
+    int tiles_across = (cols + tile_cols - 1) / tile_cols;
+    int ntiles = tiles_down * tiles_across;
+    int tile_size = tile_rows * tile_cols * element_size;
+
+    char* extmem_buffer = bsp_stream_create_raw(ntiles * tile_size * repeat,
+                                                tile_size, 0);
+    if (extmem_buffer == 0)
+        return 0;
+
+    // Within the matrix and within a tile, the elements are stored as
+    // lines (rows or columns) of consecutive elements
+    int row_major = (layout == EBSP_ROW_MAJOR);
+    int nlines = row_major ? rows : cols;
+    int line_length = row_major ? cols : rows;
+    int tile_nlines = row_major ? tile_rows : tile_cols;
+    int tile_line_length = row_major ? tile_cols : tile_rows;
+
+    const char* src = (const char*)matrix;
+    char* dst = extmem_buffer;
+    for (int t = 0; t < ntiles; ++t) {
+        int tile_i, tile_j;
+        if (tile_order == EBSP_ROW_MAJOR) {
+            tile_i = t / tiles_across;
+            tile_j = t % tiles_across;
+        } else {
+            tile_i = t % tiles_down;
+            tile_j = t / tiles_down;
+        }
+
+        // First line of the tile, and its offset within that line
+        int first_line = row_major ? tile_i * tile_rows : tile_j * tile_cols;
+        int first_element =
+            row_major ? tile_j * tile_cols : tile_i * tile_rows;
+
+        // Copy the part of every line that is inside the matrix,
+        // and pad the rest with zeros
+        int copy_length = line_length - first_element;
+        if (copy_length > tile_line_length)
+            copy_length = tile_line_length;
+
+        for (int l = 0; l < tile_nlines; ++l) {
+            int line = first_line + l;
+            int ncopy = (line < nlines) ? copy_length : 0;
+            if (ncopy > 0)
+                memcpy(dst,
+                       src + ((size_t)line * line_length + first_element) *
+                                 element_size,
+                       ncopy * element_size);
+            memset(dst + ncopy * element_size, 0,
+                   (tile_line_length - ncopy) * element_size);
+            dst += tile_line_length * element_size;
+        }
+    }
+
+    // Repetitions are copies of the first sequence of tiles
+    for (int r = 1; r < repeat; ++r)
+        memcpy(extmem_buffer + (size_t)r * ntiles * tile_size, extmem_buffer,
+               (size_t)ntiles * tile_size);
+
+    return extmem_buffer;
+}
+
+int bsp_stream_reader_open(ebsp_stream_reader* reader, const void* stream) {
+    void* extmem_addr = _arm_to_e_pointer((void*)stream);
+    for (int i = 0; i < state.combuf.nstreams; i++) {
+        if (state.shared_streams[i].extmem_addr != extmem_addr)
+            continue;
+        if (state.shared_streams[i].pipe_end != PIPE_NONE) {
+            printf("ERROR: a pipe can not be read with a stream reader\n");
+            return 0;
+        }
+        reader->id = i;
+        reader->offset = 0;
+        reader->data = (char*)stream;
+        return 1;
+    }
+    printf("ERROR: bsp_stream_reader_open did not get a stream\n");
+    return 0;
+}
+
+int bsp_stream_reader_poll(ebsp_stream_reader* reader, void** token) {
+    *token = NULL;
+
+    ebsp_stream_descriptor* descriptors = state.stream_descriptors;
+    if (descriptors == NULL)
+        return 0;
+
+    // The offset is published after the data has arrived
+    unsigned published =
+        ((volatile ebsp_stream_descriptor*)&descriptors[reader->id])->published;
+    __sync_synchronize();
+    if (reader->offset >= published)
+        return 0;
+
+    ebsp_stream_descriptor* x = &state.shared_streams[reader->id];
+    char* cursor = reader->data + reader->offset;
+    int size;
+    if (x->raw) {
+        // Tokens are published whole, so only the last one can be smaller
+        size = published - reader->offset;
+        if (size > x->max_chunksize)
+            size = x->max_chunksize;
+        *token = cursor;
+        reader->offset += size;
+    } else {
+        size = ((int*)cursor)[1];
+        if (size == 0)
+            return 0;
+        *token = cursor + 2 * sizeof(int);
+        reader->offset += 2 * sizeof(int) + size;
+    }
+    return size;
+}
+
+int bsp_stream_reader_wait(ebsp_stream_reader* reader, void** token) {
+    for (;;) {
+        // If ebsp_spmd() has finished, everything has been published
+        int running = state.spmd_running;
+        __sync_synchronize();
+        int size = bsp_stream_reader_poll(reader, token);
+        if (size != 0 || !running)
+            return size;
+        _microsleep(10);
+    }
+}
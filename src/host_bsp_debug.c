@@ -19,7 +19,6 @@ and the GNU Lesser General Public License along with this program,
 see the files COPYING and COPYING.LESSER. If not, see
 <http://www.gnu.org/licenses/>.
 */
-#ifdef DEBUG
 #include "host_bsp_private.h"
 
 #include <stdio.h>
@@ -28,11 +27,13 @@ see the files COPYING and COPYING.LESSER. If not, see
 #include <elf.h>
 
 void _read_elf(const char* filename);
-void _parse_elf(char* buffer, size_t fsize);
-void _parse_symbols(char* buffer, size_t fsize, Elf32_Shdr* shdr,
-                    size_t symtab_index);
+static void _parse_elf(char* buffer, size_t fsize);
+static void _parse_symbols(char* buffer, size_t fsize, Elf32_Shdr* shdr,
+                           size_t symtab_index);
 Symbol* _get_symbol_by_addr(void* addr);
 Symbol* _get_symbol_by_name(const char* symbol);
+static Symbol* _get_variable(const char* name, int offset, int size,
+                             const char* caller);
 
 void _read_elf(const char* filename) {
     state.e_symbols = 0;
@@ -65,14 +66,14 @@ void _read_elf(const char* filename) {
 }
 
 #define EM_ADAPTEVA_EPIPHANY 0x1223 /* Adapteva's Epiphany architecture.  */
-int is_epiphany_exec_elf(Elf32_Ehdr* ehdr) {
+static int is_epiphany_exec_elf(Elf32_Ehdr* ehdr) {
     return ehdr && memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0 &&
            ehdr->e_ident[EI_CLASS] == ELFCLASS32 && ehdr->e_type == ET_EXEC &&
            ehdr->e_version == EV_CURRENT &&
            ehdr->e_machine == EM_ADAPTEVA_EPIPHANY;
 }
 
-void _parse_elf(char* buffer, size_t fsize) {
+static void _parse_elf(char* buffer, size_t fsize) {
     Elf32_Ehdr* ehdr = (Elf32_Ehdr*)buffer;
     Elf32_Shdr* shdr;
 
@@ -90,8 +91,8 @@ void _parse_elf(char* buffer, size_t fsize) {
     return;
 }
 
-void _parse_symbols(char* buffer, size_t fsize, Elf32_Shdr* shdr,
-                    size_t symtab_index) {
+static void _parse_symbols(char* buffer, size_t fsize, Elf32_Shdr* shdr,
+                           size_t symtab_index) {
     Elf32_Shdr* symtab = &shdr[symtab_index];
 
     size_t count = symtab->sh_size / symtab->sh_entsize;
@@ -146,4 +147,54 @@ Symbol* _get_symbol_by_name(const char* symbol) {
     }
     return 0;
 }
-#endif
+
+// Finds a variable in local memory and checks that the range
+// [offset, offset + size) lies within it
+static Symbol* _get_variable(const char* name, int offset, int size,
+                             const char* caller) {
+    Symbol* sym = _get_symbol_by_name(name);
+    if (sym == 0 || sym->type != STT_OBJECT) {
+        fprintf(stderr, "ERROR: %s: no variable named %s in %s.\n", caller,
+                name, state.e_fullpath);
+        return 0;
+    }
+    if (sym->value & 0xfff00000) {
+        fprintf(stderr, "ERROR: %s: variable %s is not in local memory.\n",
+                caller, name);
+        return 0;
+    }
+    if (offset < 0 || size < 0 || offset + size > sym->size) {
+        fprintf(stderr,
+                "ERROR: %s: %d bytes at offset %d do not fit in variable %s "
+                "of %d bytes.\n",
+                caller, size, offset, name, (int)sym->size);
+        return 0;
+    }
+    return sym;
+}
+
+off_t ebsp_get_symbol_address(const char* name) {
+    Symbol* sym = _get_symbol_by_name(name);
+    if (sym == 0) {
+        fprintf(stderr, "ERROR: no symbol named %s in %s.\n", name,
+                state.e_fullpath);
+        return 0;
+    }
+    return (off_t)sym->value;
+}
+
+int ebsp_write_symbol(int pid, const char* name, const void* src, int offset,
+                      int size) {
+    Symbol* sym = _get_variable(name, offset, size, "ebsp_write_symbol");
+    if (sym == 0)
+        return 0;
+    return ebsp_write(pid, (void*)src, (off_t)(sym->value + offset), size);
+}
+
+int ebsp_read_symbol(int pid, const char* name, void* dst, int offset,
+                     int size) {
+    Symbol* sym = _get_variable(name, offset, size, "ebsp_read_symbol");
+    if (sym == 0)
+        return 0;
+    return ebsp_read(pid, (off_t)(sym->value + offset), dst, size);
+}
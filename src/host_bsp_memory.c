@@ -67,7 +67,12 @@ int ebsp_read(int pid, off_t src, void* dst, int size) {
 }
 
 int _write_core_syncstate(int pid, int syncstate) {
-    return ebsp_write(pid, &syncstate, (off_t)state.combuf.syncstate_ptr, 1);
+    if (!ebsp_write(pid, &syncstate, (off_t)state.combuf.syncstate_ptr, 1))
+        return 0;
+
+    // Raise the user interrupt, to wake up a core that waits for this
+    uint32_t ilat = 1 << 9; // E_USER_INT
+    return ebsp_write(pid, &ilat, E_REG_ILATST, sizeof(uint32_t));
 }
 
 int _write_extmem(void* src, off_t offset, int size) {
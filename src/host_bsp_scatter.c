@@ -0,0 +1,245 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+#include "host_bsp_private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The elements of an array that belong to a single core:
+// `count` elements, starting at `first`, `stride` elements apart
+typedef struct {
+    int first;
+    int count;
+    int stride;
+} ebsp_part;
+
+static void _get_parts(int count, ebsp_distribution dist, ebsp_part* parts) {
+    int p = state.nprocs_used;
+    int base = count / p;
+    int rem = count % p;
+    for (int s = 0; s < p; s++) {
+        parts[s].count = base + (s < rem ? 1 : 0);
+        if (dist == EBSP_DIST_CYCLIC) {
+            parts[s].first = s;
+            parts[s].stride = p;
+        } else {
+            parts[s].first = s * base + (s < rem ? s : rem);
+            parts[s].stride = 1;
+        }
+    }
+}
+
+static void _get_parts_v(const int* counts, ebsp_part* parts) {
+    int first = 0;
+    for (int s = 0; s < state.nprocs_used; s++) {
+        parts[s].first = first;
+        parts[s].count = counts[s];
+        parts[s].stride = 1;
+        first += counts[s];
+    }
+}
+
+// Copies a part of `array` into the contiguous buffer `packed` or back
+static void _copy_part(void* packed, void* array, const ebsp_part* part,
+                       int elem_size, int unpack) {
+    char* a = (char*)array + part->first * elem_size;
+    char* b = (char*)packed;
+    if (part->stride == 1) {
+        if (unpack)
+            memcpy(a, b, part->count * elem_size);
+        else
+            memcpy(b, a, part->count * elem_size);
+        return;
+    }
+    for (int i = 0; i < part->count; i++) {
+        if (unpack)
+            memcpy(a, b, elem_size);
+        else
+            memcpy(b, a, elem_size);
+        a += part->stride * elem_size;
+        b += elem_size;
+    }
+}
+
+// Writes the parts to core memory at `dst`, or when `to_extmem` is set,
+// to newly allocated external memory whose address is written to `dst`.
+// On failure the external memory allocated by this call is freed again.
+static int _scatter_parts(const void* src, int elem_size,
+                          const ebsp_part* parts, off_t dst, int to_extmem) {
+    void* packed = NULL;
+    int packed_size = 0;
+    int result = 1;
+    void* regions[NPROCS] = {NULL};
+
+    for (int s = 0; s < state.nprocs_used && result; s++) {
+        int nbytes = parts[s].count * elem_size;
+
+        if (to_extmem) {
+            void* buffer = NULL;
+            if (nbytes != 0) {
+                buffer = ebsp_ext_malloc(nbytes);
+                if (buffer == NULL) {
+                    fprintf(stderr, "ERROR: not enough external memory to "
+                                    "scatter %d bytes to core %d.\n",
+                            nbytes, s);
+                    result = 0;
+                    break;
+                }
+                regions[s] = buffer;
+                _copy_part(buffer, (void*)src, &parts[s], elem_size, 0);
+                buffer = _arm_to_e_pointer(buffer);
+            }
+            unsigned e_ptr = (unsigned)buffer;
+            result = ebsp_write(s, &e_ptr, dst, sizeof(unsigned));
+            continue;
+        }
+
+        if (nbytes == 0)
+            continue;
+
+        if (parts[s].stride == 1) {
+            // No need to pack contiguous data
+            result = ebsp_write(
+                s, (char*)src + parts[s].first * elem_size, dst, nbytes);
+            continue;
+        }
+
+        if (nbytes > packed_size) {
+            free(packed);
+            packed = malloc(nbytes);
+            packed_size = nbytes;
+            if (packed == NULL) {
+                fprintf(stderr, "ERROR: could not allocate %d bytes in "
+                                "ebsp_scatter_down.\n",
+                        nbytes);
+                return 0;
+            }
+        }
+        _copy_part(packed, (void*)src, &parts[s], elem_size, 0);
+        result = ebsp_write(s, packed, dst, nbytes);
+    }
+
+    free(packed);
+    if (!result)
+        for (int s = 0; s < state.nprocs_used; s++)
+            if (regions[s] != NULL)
+                ebsp_free(regions[s]);
+    return result;
+}
+
+// Reads the parts from core memory at `src`, or when `from_extmem` is set,
+// from the external memory whose address is stored at `src`
+static int _gather_parts(void* dst, int elem_size, const ebsp_part* parts,
+                         off_t src, int from_extmem) {
+    void* packed = NULL;
+    int packed_size = 0;
+    int result = 1;
+
+    for (int s = 0; s < state.nprocs_used && result; s++) {
+        int nbytes = parts[s].count * elem_size;
+        if (nbytes == 0)
+            continue;
+
+        if (from_extmem) {
+            unsigned e_ptr = 0;
+            result = ebsp_read(s, src, &e_ptr, sizeof(unsigned));
+            if (result && e_ptr == 0) {
+                fprintf(stderr,
+                        "ERROR: core %d has no external memory to gather.\n",
+                        s);
+                result = 0;
+            }
+            if (result)
+                _copy_part(_e_to_arm_pointer((void*)e_ptr), dst, &parts[s],
+                           elem_size, 1);
+            continue;
+        }
+
+        if (parts[s].stride == 1) {
+            result = ebsp_read(s, src,
+                               (char*)dst + parts[s].first * elem_size, nbytes);
+            continue;
+        }
+
+        if (nbytes > packed_size) {
+            free(packed);
+            packed = malloc(nbytes);
+            packed_size = nbytes;
+            if (packed == NULL) {
+                fprintf(stderr, "ERROR: could not allocate %d bytes in "
+                                "ebsp_gather_up.\n",
+                        nbytes);
+                return 0;
+            }
+        }
+        result = ebsp_read(s, src, packed, nbytes);
+        if (result)
+            _copy_part(packed, dst, &parts[s], elem_size, 1);
+    }
+
+    free(packed);
+    return result;
+}
+
+int ebsp_scatter_down(const void* src, int count, int elem_size,
+                      ebsp_distribution dist, off_t dst) {
+    ebsp_part parts[NPROCS];
+    _get_parts(count, dist, parts);
+    return _scatter_parts(src, elem_size, parts, dst, 0);
+}
+
+int ebsp_scatterv_down(const void* src, const int* counts, int elem_size,
+                       off_t dst) {
+    ebsp_part parts[NPROCS];
+    _get_parts_v(counts, parts);
+    return _scatter_parts(src, elem_size, parts, dst, 0);
+}
+
+int ebsp_scatter_down_ext(const void* src, int count, int elem_size,
+                          ebsp_distribution dist, off_t dst_ptr) {
+    ebsp_part parts[NPROCS];
+    _get_parts(count, dist, parts);
+    return _scatter_parts(src, elem_size, parts, dst_ptr, 1);
+}
+
+int ebsp_gather_up(void* dst, int count, int elem_size,
+                   ebsp_distribution dist, off_t src) {
+    ebsp_part parts[NPROCS];
+    _get_parts(count, dist, parts);
+    return _gather_parts(dst, elem_size, parts, src, 0);
+}
+
+int ebsp_gatherv_up(void* dst, const int* counts, int elem_size, off_t src) {
+    ebsp_part parts[NPROCS];
+    _get_parts_v(counts, parts);
+    return _gather_parts(dst, elem_size, parts, src, 0);
+}
+
+int ebsp_gather_up_ext(void* dst, int count, int elem_size,
+                       ebsp_distribution dist, off_t src_ptr) {
+    ebsp_part parts[NPROCS];
+    _get_parts(count, dist, parts);
+    return _gather_parts(dst, elem_size, parts, src_ptr, 1);
+}
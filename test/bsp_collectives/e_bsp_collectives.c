@@ -0,0 +1,112 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+#include <e_bsp.h>
+#include "../common.h"
+
+int main() {
+    bsp_begin();
+    int s = bsp_pid();
+    int p = bsp_nprocs();
+
+    // test: broadcast from a root other than 0
+    int value[2] = {0, 0};
+    if (s == 3) {
+        value[0] = 42;
+        value[1] = 43;
+    }
+    ebsp_broadcast(value, sizeof(value), 3);
+    EBSP_MSG_ORDERED("%i %i", value[0], value[1]);
+    // expect_for_pid: ("42 43")
+
+    // test: reduce to a single processor
+    int x = s + 1;
+    int sum = 0;
+    ebsp_reduce(&x, &sum, sizeof(int), ebsp_combine_int_sum, 0);
+    if (s == 0)
+        ebsp_message("%i", sum);
+    // expect: ($00: 136)
+
+    // test: allreduce with src equal to dst
+    float y = (float)s;
+    ebsp_allreduce(&y, &y, sizeof(float), ebsp_combine_float_max);
+    EBSP_MSG_ORDERED("%i", (int)y);
+    // expect_for_pid: (15)
+
+    // test: inclusive scan
+    int one = 1;
+    int prefix = 0;
+    ebsp_scan(&one, &prefix, sizeof(int), ebsp_combine_int_sum);
+    EBSP_MSG_ORDERED("%i", prefix);
+    // expect_for_pid: (pid + 1)
+
+    // test: gather on a root other than 0
+    int pids[16];
+    ebsp_gather(&s, pids, sizeof(int), 1);
+    if (s == 1) {
+        int correct = 0;
+        for (int i = 0; i < p; i++)
+            if (pids[i] == i)
+                correct++;
+        ebsp_message("%i", correct);
+    }
+    // expect: ($01: 16)
+
+    // test: all-to-all exchange, block j of core s contains 100 * s + j
+    int send[16];
+    int recv[16];
+    for (int j = 0; j < p; j++)
+        send[j] = 100 * s + j;
+    ebsp_alltoall(send, recv, sizeof(int));
+    int correct = 0;
+    for (int i = 0; i < p; i++)
+        if (recv[i] == 100 * i + s)
+            correct++;
+    EBSP_MSG_ORDERED("%i", correct);
+    // expect_for_pid: (16)
+
+    // test: variable-count exchange, core s sends j + 1 integers to core j
+    int vsend[16 * 17 / 2];
+    int vrecv[16 * 16];
+    int sendcounts[16], sdispls[16], rdispls[16];
+    int offset = 0;
+    for (int j = 0; j < p; j++) {
+        sendcounts[j] = (j + 1) * sizeof(int);
+        sdispls[j] = offset * sizeof(int);
+        for (int k = 0; k <= j; k++)
+            vsend[offset++] = s;
+        rdispls[j] = j * (s + 1) * sizeof(int);
+    }
+    ebsp_alltoallv(vsend, sendcounts, sdispls, vrecv, rdispls);
+    correct = 0;
+    for (int i = 0; i < p; i++)
+        for (int k = 0; k <= s; k++)
+            if (vrecv[i * (s + 1) + k] == i)
+                correct++;
+    EBSP_MSG_ORDERED("%i", correct);
+    // expect_for_pid: (16 * (pid + 1))
+
+    bsp_end();
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+#include <e_bsp.h>
+#include "../common.h"
+
+int main() {
+    bsp_begin();
+    int s = bsp_pid();
+    int p = bsp_nprocs();
+
+    int tag = 1;
+    ebsp_set_combiner(&tag, ebsp_combine_int_sum);
+
+    // test: messages with a combined tag are folded into one message
+    for (int i = 1; i <= 3; i++) {
+        int payload = s + i;
+        bsp_send((s + 1) % p, &tag, &payload, sizeof(int));
+    }
+    // messages with other tags are not combined
+    tag = 2;
+    for (int i = 0; i < 2; i++)
+        bsp_send((s + 1) % p, &tag, &s, sizeof(int));
+    bsp_sync();
+
+    int packets = 0;
+    int accum_bytes = 0;
+    bsp_qsize(&packets, &accum_bytes);
+    EBSP_MSG_ORDERED("%i", packets);
+    // expect_for_pid: (3)
+
+    int sum = 0;
+    for (int i = 0; i < packets; i++) {
+        int status = 0;
+        int payload = 0;
+        bsp_get_tag(&status, &tag);
+        bsp_move(&payload, sizeof(int));
+        if (tag == 1)
+            sum = payload;
+    }
+    EBSP_MSG_ORDERED("%i", sum);
+    // expect_for_pid: (3 * ((pid + 15) % 16) + 6)
+
+    // test: float combiner on arrays, and the combiner stays
+    // attached over multiple supersteps
+    tag = 3;
+    ebsp_set_combiner(&tag, ebsp_combine_float_max);
+    for (int i = 0; i < 4; i++) {
+        float payload[2] = {(float)i, (float)-i};
+        bsp_send((s + 1) % p, &tag, payload, sizeof(payload));
+    }
+    bsp_sync();
+
+    float result[2] = {0, 0};
+    bsp_qsize(&packets, &accum_bytes);
+    bsp_move(result, sizeof(result));
+    EBSP_MSG_ORDERED("%i %i %i", packets, (int)result[0], (int)result[1]);
+    // expect_for_pid: ("1 3 0")
+
+    // test: a removed combiner no longer combines messages
+    tag = 1;
+    ebsp_set_combiner(&tag, 0);
+    for (int i = 0; i < 2; i++)
+        bsp_send((s + 1) % p, &tag, &s, sizeof(int));
+    bsp_sync();
+
+    bsp_qsize(&packets, &accum_bytes);
+    EBSP_MSG_ORDERED("%i", packets);
+    // expect_for_pid: (2)
+
+    bsp_end();
+
+    return 0;
+}
@@ -132,6 +132,128 @@ int main()
                 ebsp_free(remotebuffer[i]);
     }
     
+    // Chain of many small transfers that are pushed while the DMA is busy.
+    // Wait for one in the middle first, then for all of them.
+#define CHAINCOUNT 32
+    ebsp_dma_handle chain[CHAINCOUNT];
+    int* src = ebsp_ext_malloc(CHAINCOUNT * 2 * sizeof(int));
+    int* dst = ebsp_malloc(CHAINCOUNT * 2 * sizeof(int));
+    if (src && dst) {
+        for (int i = 0; i < 2 * CHAINCOUNT; i++) {
+            src[i] = i;
+            dst[i] = -1;
+        }
+        for (int i = 0; i < CHAINCOUNT; i++)
+            ebsp_dma_push(&chain[i], &dst[2 * i], &src[2 * i], 2 * sizeof(int));
+
+        ebsp_dma_wait(&chain[CHAINCOUNT / 2]);
+        for (int i = 0; i <= CHAINCOUNT / 2; i++)
+            if (dst[2 * i] != 2 * i || dst[2 * i + 1] != 2 * i + 1)
+                globalPass = 0;
+
+        for (int i = 0; i < CHAINCOUNT; i++)
+            ebsp_dma_wait(&chain[i]);
+        for (int i = 0; i < 2 * CHAINCOUNT; i++)
+            if (dst[i] != i)
+                globalPass = 0;
+        if (!globalPass)
+            ebsp_message("ERROR: chained DMA transfers incorrect");
+    } else {
+        globalPass = 0;
+        ebsp_message("ERROR: allocation for chained transfers failed");
+    }
+    if (src)
+        ebsp_free(src);
+    if (dst)
+        ebsp_free(dst);
+
+    // Transfers on both channels at the same time, in both directions
+    ebsp_dma_handle in_handle[3];
+    ebsp_dma_handle out_handle[3];
+    ebsp_dma_channel channels[3] = {EBSP_DMA_CHANNEL0, EBSP_DMA_CHANNEL1,
+                                    EBSP_DMA_ANY};
+    int* ext = ebsp_ext_malloc(6 * 0x40 * sizeof(int));
+    int* loc = ebsp_malloc(6 * 0x40 * sizeof(int));
+    if (ext && loc) {
+        for (int i = 0; i < 3 * 0x40; i++) {
+            ext[i] = i;
+            loc[i] = -1;
+            ext[3 * 0x40 + i] = -1;
+            loc[3 * 0x40 + i] = -i;
+        }
+        for (int c = 0; c < 3; c++) {
+            ebsp_dma_push_channel(&in_handle[c], &loc[c * 0x40],
+                                  &ext[c * 0x40], 0x40 * sizeof(int),
+                                  channels[c]);
+            ebsp_dma_push_channel(&out_handle[c], &ext[(3 + c) * 0x40],
+                                  &loc[(3 + c) * 0x40], 0x40 * sizeof(int),
+                                  channels[2 - c]);
+        }
+        for (int c = 0; c < 3; c++) {
+            ebsp_dma_wait(&out_handle[c]);
+            ebsp_dma_wait(&in_handle[c]);
+        }
+        int channelPass = 1;
+        for (int i = 0; i < 3 * 0x40; i++)
+            if (loc[i] != i || ext[3 * 0x40 + i] != -i)
+                channelPass = 0;
+        if (!channelPass) {
+            globalPass = 0;
+            ebsp_message("ERROR: DMA transfers on both channels incorrect");
+        }
+    } else {
+        globalPass = 0;
+        ebsp_message("ERROR: allocation for channel transfers failed");
+    }
+    if (ext)
+        ebsp_free(ext);
+    if (loc)
+        ebsp_free(loc);
+
+    // A list with a strided transfer: copy a 4x4 tile out of an 8x8 matrix,
+    // together with a contiguous block, and an empty transfer
+    ebsp_dma_handle list_handle[3];
+    int* matrix = ebsp_ext_malloc(8 * 8 * sizeof(int));
+    int* tile = ebsp_malloc(4 * 4 * sizeof(int) + 8 * sizeof(int));
+    if (matrix && tile) {
+        for (int i = 0; i < 8 * 8; i++)
+            matrix[i] = i;
+        for (int i = 0; i < 4 * 4 + 8; i++)
+            tile[i] = -1;
+        ebsp_dma_item items[3] = {
+            {tile, &matrix[2 * 8 + 3], 4 * sizeof(int), 4, 4 * sizeof(int),
+             8 * sizeof(int)},
+            {&tile[16], &matrix[56], 8 * sizeof(int), 1, 0, 0},
+            {0, 0, 0, 0, 0, 0}};
+        ebsp_dma_push_list(list_handle, items, 3, EBSP_DMA_ANY);
+
+        // The empty transfer is finished immediately
+        if (ebsp_dma_wait_any(&list_handle[2], 1) != 0 ||
+            !ebsp_dma_test(&list_handle[2]))
+            globalPass = 0;
+
+        ebsp_dma_wait_all(list_handle, 3);
+        int listPass = 1;
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                if (tile[i * 4 + j] != (2 + i) * 8 + 3 + j)
+                    listPass = 0;
+        for (int i = 0; i < 8; i++)
+            if (tile[16 + i] != 56 + i)
+                listPass = 0;
+        if (!listPass || !ebsp_dma_test(&list_handle[0])) {
+            globalPass = 0;
+            ebsp_message("ERROR: DMA list transfers incorrect");
+        }
+    } else {
+        globalPass = 0;
+        ebsp_message("ERROR: allocation for list transfers failed");
+    }
+    if (matrix)
+        ebsp_free(matrix);
+    if (tile)
+        ebsp_free(tile);
+
     if (globalPass && s == 0)
         ebsp_message("PASS");
     // expect: ($00: PASS)
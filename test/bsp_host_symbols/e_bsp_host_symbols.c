@@ -0,0 +1,53 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <e_bsp.h>
+#include "../common.h"
+
+// These are written by the host before the program starts. They are
+// initialized so that they are placed in .data, which is not cleared
+// when the program starts.
+int parameter = -1;
+int block[4] = {-1, -1, -1, -1};
+
+// This is read by the host after the program has finished
+int result;
+
+int main() {
+    bsp_begin();
+
+    // test: variable written by name
+    EBSP_MSG_ORDERED("%i", parameter);
+    // expect_for_pid: (10 * pid)
+
+    // test: array written at the address of a symbol
+    EBSP_MSG_ORDERED("%i", block[0] + block[1] + block[2] + block[3]);
+    // expect_for_pid: (16 * pid + 6)
+
+    result = parameter + block[0];
+
+    bsp_end();
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <host_bsp.h>
+#include <stdio.h>
+
+int main(int argc, char** argv) {
+    bsp_init("e_bsp_host_symbols.elf", argc, argv);
+    bsp_begin(bsp_nprocs());
+
+    int p = bsp_nprocs();
+    for (int s = 0; s < p; s++) {
+        int parameter = 10 * s;
+        ebsp_write_symbol(s, "parameter", &parameter, 0, sizeof(int));
+    }
+
+    int data[64];
+    for (int i = 0; i < 64; i++)
+        data[i] = i;
+    ebsp_scatter_down(data, 64, sizeof(int), EBSP_DIST_BLOCK,
+                      ebsp_get_symbol_address("block"));
+
+    ebsp_spmd();
+
+    // test: variable read by name
+    int correct = 0;
+    for (int s = 0; s < p; s++) {
+        int result = 0;
+        ebsp_read_symbol(s, "result", &result, 0, sizeof(int));
+        if (result == 14 * s)
+            correct++;
+    }
+    printf("%i\n", correct);
+    // expect: (16)
+
+    // test: writes that do not fit in the variable are refused
+    fflush(stdout);
+    printf("%i\n", ebsp_write_symbol(0, "parameter", data, 0, 8));
+    // expect: (ERROR: ebsp_write_symbol: 8 bytes at offset 0 do not fit in variable parameter of 4 bytes.)
+    // expect: (0)
+
+    bsp_end();
+
+    return 0;
+}
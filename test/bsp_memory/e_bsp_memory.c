@@ -86,7 +86,54 @@ int main()
         if (localbuffer) ebsp_free(localbuffer);
         if (remotebuffer) ebsp_free(remotebuffer);
     }
-    
+
+    // Copy with every combination of source and destination alignment,
+    // from local and from external memory, at sizes that go through the
+    // byte, word, shifted and DMA paths of ebsp_memcpy
+#define COPYCOUNT 4
+    int copySizes[COPYCOUNT] = {3, 21, 100, 0x120};
+    unsigned char* source[2];
+    source[0] = ebsp_malloc(0x140);
+    source[1] = ebsp_ext_malloc(0x140);
+    unsigned char* target = ebsp_malloc(0x140);
+    if (source[0] && source[1] && target) {
+        for (int i = 0; i < 0x140; i++)
+            source[0][i] = source[1][i] = (unsigned char)(i * 7 + 1);
+
+        int copyPass = 1;
+        for (int mem = 0; mem < 2; mem++)
+            for (int size = 0; size < COPYCOUNT; size++)
+                for (int soff = 0; soff < 8; soff++)
+                    for (int doff = 0; doff < 8; doff++) {
+                        int n = copySizes[size];
+                        for (int i = 0; i < 0x140; i++)
+                            target[i] = 0;
+                        ebsp_memcpy(&target[doff], &source[mem][soff], n);
+                        for (int i = 0; i < doff; i++)
+                            if (target[i] != 0)
+                                copyPass = 0;
+                        for (int i = 0; i < n; i++)
+                            if (target[doff + i] != source[0][soff + i])
+                                copyPass = 0;
+                        if (target[doff + n] != 0)
+                            copyPass = 0;
+                    }
+
+        if (!copyPass) {
+            globalPass = 0;
+            ebsp_message("ERROR: ebsp_memcpy copied incorrect data");
+        }
+    } else {
+        globalPass = 0;
+        ebsp_message("ERROR: allocation for ebsp_memcpy failed");
+    }
+    if (source[0])
+        ebsp_free(source[0]);
+    if (source[1])
+        ebsp_free(source[1]);
+    if (target)
+        ebsp_free(target);
+
     if (s == 0)
         ebsp_message(globalPass ? "PASS" : "FAIL");
     // expect: ($00: PASS)
@@ -0,0 +1,56 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+#include <e_bsp.h>
+#include "../common.h"
+
+// These are written by the host before the program starts. They are
+// initialized so that they are placed in .data, which is not cleared
+// when the program starts.
+int block[4] = {-1, -1, -1, -1};
+int* cyclic = (int*)-1;
+
+// This is read by the host after the program has finished
+int result[4];
+
+int main() {
+    bsp_begin();
+
+    // test: block distribution in local memory
+    EBSP_MSG_ORDERED("%i", block[0] + block[1] + block[2] + block[3]);
+    // expect_for_pid: (16 * pid + 6)
+
+    // test: cyclic distribution in external memory
+    int* c = cyclic;
+    EBSP_MSG_ORDERED("%i", c[0] + c[1] + c[2] + c[3]);
+    // expect_for_pid: (4 * pid + 96)
+
+    for (int i = 0; i < 4; i++) {
+        result[i] = 2 * block[i];
+        c[i] += 1;
+    }
+
+    bsp_end();
+
+    return 0;
+}
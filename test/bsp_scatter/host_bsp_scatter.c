@@ -0,0 +1,80 @@
+/*
+This file is part of the Epiphany BSP library.
+
+Copyright (C) 2014-2015 Buurlage Wits
+Support e-mail: <info@buurlagewits.nl>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+
+#include <host_bsp.h>
+#include <stdio.h>
+
+int main(int argc, char** argv) {
+    bsp_init("e_bsp_scatter.elf", argc, argv);
+    bsp_begin(bsp_nprocs());
+
+    // The arrays are global variables of the Epiphany program
+    off_t block_addr = ebsp_get_symbol_address("block");
+    off_t cyclic_addr = ebsp_get_symbol_address("cyclic");
+    off_t result_addr = ebsp_get_symbol_address("result");
+
+    int data[64];
+    for (int i = 0; i < 64; i++)
+        data[i] = i;
+    ebsp_scatter_down(data, 64, sizeof(int), EBSP_DIST_BLOCK, block_addr);
+    ebsp_scatter_down_ext(data, 64, sizeof(int), EBSP_DIST_CYCLIC,
+                          cyclic_addr);
+
+    ebsp_spmd();
+
+    // test: gather results from local memory
+    int result[64];
+    ebsp_gather_up(result, 64, sizeof(int), EBSP_DIST_BLOCK, result_addr);
+    int correct = 0;
+    for (int i = 0; i < 64; i++)
+        if (result[i] == 2 * i)
+            correct++;
+    printf("%i\n", correct);
+    // expect: (64)
+
+    // test: gather results from external memory
+    ebsp_gather_up_ext(result, 64, sizeof(int), EBSP_DIST_CYCLIC,
+                       cyclic_addr);
+    correct = 0;
+    for (int i = 0; i < 64; i++)
+        if (result[i] == i + 1)
+            correct++;
+    printf("%i\n", correct);
+    // expect: (64)
+
+    // test: variable counts per core, the first two results of every core
+    int counts[16];
+    for (int s = 0; s < 16; s++)
+        counts[s] = 2;
+    ebsp_gatherv_up(result, counts, sizeof(int), result_addr);
+    correct = 0;
+    for (int i = 0; i < 32; i++)
+        if (result[i] == 2 * (4 * (i / 2) + i % 2))
+            correct++;
+    printf("%i\n", correct);
+    // expect: (32)
+
+    bsp_end();
+
+    return 0;
+}
@@ -164,6 +164,333 @@ int main() {
         up2 = tmp;
     }
 
+    // Reopen s1 with a deeper prefetch ring, and check that seeking is
+    // relative to the last obtained token while tokens are preloaded
+    int id = s1.id;
+    bsp_stream_close(&s1);
+    bsp_stream_open_prefetch(&s1, id, 3);
+    bsp_stream_seek_to(&s1, 0); // the stream continues where it was closed
+    int* tok = 0;
+    int first[4];
+    bsp_stream_move_down(&s1, (void**)&tok, 1);
+    first[0] = tok[0];
+    bsp_stream_seek(&s1, 1);
+    bsp_stream_move_down(&s1, (void**)&tok, 1);
+    first[1] = tok[0];
+    bsp_stream_move_down(&s1, (void**)&tok, 1);
+    first[2] = tok[0];
+    first[3] = bsp_stream_move_down(&s1, (void**)&tok, 1);
+    EBSP_MSG_ORDERED("%d %d %d %d", first[0], first[1], first[2], first[3]);
+    // expect_for_pid: ("15 7 3 0")
+
+    // Seeking in a stream with tokens of equal size
+    bsp_stream_seek_to(&s2, 2);
+    bsp_stream_move_down(&s2, (void**)&tok, 0);
+    first[0] = tok[0];
+    bsp_stream_seek(&s2, -2);
+    bsp_stream_move_down(&s2, (void**)&tok, 0);
+    first[1] = tok[0];
+    bsp_stream_seek(&s2, INT_MAX);
+    first[2] = bsp_stream_move_down(&s2, (void**)&tok, 0);
+    EBSP_MSG_ORDERED("%d %d %d", first[0], first[1], first[2]);
+    // expect_for_pid: ("14 22 0")
+
+    // Seeking in an indexed stream with tokens of different size
+    ebsp_stream s3;
+    bsp_stream_open(&s3, 2 * bsp_nprocs() + s);
+    for (int t = 0; t < 3; t++) {
+        for (int j = 0; j < 4; j++)
+            up1[j] = 10 * t + j;
+        bsp_stream_move_up(&s3, up1, (t == 1 ? 16 : 8), 1);
+    }
+    bsp_stream_seek_to(&s3, 1);
+    first[0] = bsp_stream_move_down(&s3, (void**)&tok, 1);
+    first[1] = tok[3];
+    bsp_stream_seek(&s3, -2);
+    bsp_stream_move_down(&s3, (void**)&tok, 1);
+    first[2] = tok[1];
+    bsp_stream_seek_to(&s3, 2);
+    bsp_stream_move_down(&s3, (void**)&tok, 1);
+    first[3] = tok[0];
+    EBSP_MSG_ORDERED("%d %d %d %d", first[0], first[1], first[2], first[3]);
+    // expect_for_pid: ("16 13 1 20")
+    bsp_stream_close(&s3);
+
+    // Tokens moved up from buffers owned by the stream are published in
+    // order, also when the transfer of a small token finishes before that
+    // of a large token that was committed earlier
+    ebsp_stream ord;
+    bsp_stream_open_prefetch(&ord, 9 * bsp_nprocs() + 8 + s, 4);
+    int ord_wrong = 0;
+    unsigned ord_published = 0;
+    for (int t = 0; t < 12; t++) {
+        int* token = bsp_stream_acquire(&ord);
+        int words = (t % 4 == 0) ? 64 : 2;
+        for (int j = 0; j < words; j++)
+            token[j] = 100 * t + j;
+        bsp_stream_commit(&ord, words * sizeof(int));
+
+        // Every token before the published offset has arrived completely
+        if (ord.published < ord_published)
+            ord_wrong++;
+        ord_published = ord.published;
+        unsigned offset = 0;
+        for (int u = 0; offset < ord_published; u++) {
+            int* header = (int*)(ord.extmem_start + offset);
+            int* data = header + 2;
+            for (int j = 0; j < header[1] / sizeof(int); j++)
+                if (data[j] != 100 * u + j)
+                    ord_wrong++;
+            offset += 2 * sizeof(int) + header[1];
+        }
+        if (offset != ord_published)
+            ord_wrong++;
+    }
+    // A commit needs a buffer that was acquired for it
+    if (s == 0 && bsp_stream_commit(&ord, 8) != 0)
+        ord_wrong++;
+    // expect: ($00: BSP ERROR: no buffer of stream 152 was acquired before the commit)
+    bsp_stream_close(&ord);
+    EBSP_MSG_ORDERED("%d %d", ord_wrong, ord.published);
+    // expect_for_pid: ("0 936")
+
+    // Raw streams: double the tokens of one stream into the other
+    ebsp_stream r1, r2;
+    bsp_stream_open_prefetch(&r1, 3 * bsp_nprocs() + s, 3);
+    bsp_stream_open(&r2, 4 * bsp_nprocs() + s);
+    int count = 0;
+    int total = 0;
+    for (;;) {
+        int size = bsp_stream_move_down(&r1, (void**)&tok, 1);
+        if (size == 0)
+            break;
+        count++;
+        total += size;
+        for (int j = 0; j < size / sizeof(int); ++j)
+            up1[j] = 2 * tok[j];
+        bsp_stream_move_up(&r2, up1, size, 1);
+    }
+    bsp_stream_seek_to(&r1, 4);
+    bsp_stream_move_down(&r1, (void**)&tok, 0);
+    EBSP_MSG_ORDERED("%d %d %d", count, total, tok[1]);
+    // expect_for_pid: ("5 56 13")
+    bsp_stream_close(&r1);
+    bsp_stream_close(&r2);
+
+    // Hand over a stream to the next core, halfway through a preloaded token
+    bsp_stream_open(&r1, 3 * bsp_nprocs() + s);
+    bsp_stream_seek_to(&r1, 1);
+    bsp_stream_move_down(&r1, (void**)&tok, 1);
+    bsp_stream_close(&r1);
+    ebsp_barrier();
+    bsp_stream_open(&r1, 3 * bsp_nprocs() + (s + 1) % bsp_nprocs());
+    bsp_stream_move_down(&r1, (void**)&tok, 0);
+    EBSP_MSG_ORDERED("%d %d", tok[0], bsp_stream_tell(&r1));
+    // expect_for_pid: ("6 2")
+    bsp_stream_close(&r1);
+
+    // All cores read the shared stream at once
+    ebsp_stream sh;
+    bsp_stream_open_prefetch(&sh, 5 * bsp_nprocs(), 3);
+    int sum = 0;
+    while (bsp_stream_move_down(&sh, (void**)&tok, 1))
+        sum += tok[0];
+    bsp_stream_seek_to(&sh, 1);
+    bsp_stream_move_down(&sh, (void**)&tok, 0);
+    EBSP_MSG_ORDERED("%d %d", sum, tok[1]);
+    // expect_for_pid: ("36 10")
+    if (s == 0)
+        bsp_stream_move_up(&sh, up1, 8, 1);
+    // expect: ($00: BSP ERROR: stream 80 is shared and can not be moved up to)
+    bsp_stream_close(&sh);
+
+    // Several tokens at once
+    bsp_stream_open(&sh, 5 * bsp_nprocs());
+    int* batch[3];
+    int sizes[3];
+    int n1 = bsp_stream_move_down_batch(&sh, (void**)batch, sizes, 3);
+    int batch_last = batch[2][0];
+    int n2 = bsp_stream_move_down_batch(&sh, (void**)batch, sizes, 3);
+    int n3 = bsp_stream_move_down_batch(&sh, (void**)batch, sizes, 3);
+    EBSP_MSG_ORDERED("%d %d %d %d %d %d", n1, n2, n3, batch_last, batch[0][0],
+                     sizes[0]);
+    // expect_for_pid: ("3 1 0 7 3 16")
+    bsp_stream_close(&sh);
+
+    // The tokens of the distributed stream are divided over the cores
+    ebsp_stream work;
+    bsp_stream_open_prefetch(&work, 5 * bsp_nprocs() + 1, 3);
+    int claimed[3] = {0, 0, 0}; // count, sum, wrong numbers
+    while (bsp_stream_move_down(&work, (void**)&tok, 1)) {
+        claimed[0]++;
+        claimed[1] += tok[0];
+        if (bsp_stream_tell(&work) != tok[3])
+            claimed[2]++;
+    }
+    bsp_stream_close(&work);
+    ebsp_allreduce(claimed, claimed, sizeof(claimed), ebsp_combine_int_sum);
+    EBSP_MSG_ORDERED("%d %d %d", claimed[0], claimed[1], claimed[2]);
+    // expect_for_pid: ("40 780 0")
+
+    // Batches take over the tokens that a distributed stream has preloaded,
+    // so every token is processed exactly once
+    bsp_stream_open_prefetch(&work, 9 * bsp_nprocs() + 6, 3);
+    int mixed[3] = {0, 0, 0}; // count, sum, sum of squares
+    while (bsp_stream_move_down(&work, (void**)&tok, 1)) {
+        mixed[0]++;
+        mixed[1] += tok[0];
+        mixed[2] += tok[0] * tok[0];
+        int n = bsp_stream_move_down_batch(&work, (void**)batch, sizes, 3);
+        for (int i = 0; i < n; i++) {
+            mixed[0]++;
+            mixed[1] += batch[i][0];
+            mixed[2] += batch[i][0] * batch[i][0];
+        }
+        if (n == 0)
+            break;
+    }
+    bsp_stream_close(&work);
+    ebsp_allreduce(mixed, mixed, sizeof(mixed), ebsp_combine_int_sum);
+    EBSP_MSG_ORDERED("%d %d %d", mixed[0], mixed[1], mixed[2]);
+    // expect_for_pid: ("40 780 20540")
+
+    // Tokens that are preloaded when a distributed stream is closed are
+    // given back, so every token is still processed exactly once
+    int handed[3] = {0, 0, 0}; // count, sum, sum of squares
+    bsp_stream_open_prefetch(&work, 9 * bsp_nprocs() + 7, 3);
+    if (bsp_stream_move_down(&work, (void**)&tok, 1)) {
+        handed[0]++;
+        handed[1] += tok[0];
+        handed[2] += tok[0] * tok[0];
+    }
+    bsp_stream_close(&work);
+    ebsp_barrier();
+    bsp_stream_open_prefetch(&work, 9 * bsp_nprocs() + 7, 3);
+    while (bsp_stream_move_down(&work, (void**)&tok, 1)) {
+        handed[0]++;
+        handed[1] += tok[0];
+        handed[2] += tok[0] * tok[0];
+    }
+    bsp_stream_close(&work);
+    ebsp_allreduce(handed, handed, sizeof(handed), ebsp_combine_int_sum);
+    EBSP_MSG_ORDERED("%d %d %d", handed[0], handed[1], handed[2]);
+    // expect_for_pid: ("64 2016 85344")
+
+    // Tokens of encoded streams are decoded on the core
+    ebsp_stream enc;
+    bsp_stream_open(&enc, 5 * bsp_nprocs() + 2 + s);
+    int decoded = 0;
+    int wrong = 0;
+    int size;
+    while ((size = bsp_stream_move_down(&enc, (void**)&tok, 1))) {
+        for (int j = 0; j < size / sizeof(int); ++j)
+            if (tok[j] != ((decoded / sizeof(int) + j) / 6) * 3 - 5)
+                wrong++;
+        decoded += size;
+    }
+    bsp_stream_seek_to(&enc, 5);
+    bsp_stream_move_down(&enc, (void**)&tok, 0);
+    EBSP_MSG_ORDERED("%d %d %d", decoded, wrong, tok[0]);
+    // expect_for_pid: ("128 0 4")
+    bsp_stream_close(&enc);
+
+    // The priority of a stream is clamped to the allowed range, and even at
+    // the highest priority the core has to wait for a token that was not
+    // preloaded yet
+    ebsp_stream urgent;
+    bsp_stream_open(&urgent, 5 * bsp_nprocs() + 2 + s);
+    bsp_stream_set_priority(&urgent, EBSP_STREAM_MAX_PRIORITY + 1);
+    unsigned stalled_before = bsp_stream_stall_cycles(&urgent);
+    bsp_stream_move_down(&urgent, (void**)&tok, 0);
+    EBSP_MSG_ORDERED("%d %d %d %d",
+                     urgent.priority == EBSP_STREAM_MAX_PRIORITY,
+                     stalled_before == 0, tok[0],
+                     bsp_stream_stall_cycles(&urgent) > 0);
+    // expect_for_pid: ("1 1 -5 1")
+    bsp_stream_close(&urgent);
+
+    // Tiled streams contain the tiles of a matrix
+    ebsp_stream tiles;
+    bsp_stream_open(&tiles, 6 * bsp_nprocs() + 2 + s);
+    int ntiles = 0;
+    int corners = 0;
+    int second[4];
+    while (bsp_stream_move_down(&tiles, (void**)&tok, 0)) {
+        if (ntiles == 1)
+            for (int j = 0; j < 4; ++j)
+                second[j] = tok[j];
+        corners += tok[0];
+        ntiles++;
+    }
+    bsp_stream_close(&tiles);
+    EBSP_MSG_ORDERED("%d %d %d %d %d %d", ntiles, corners, second[0],
+                     second[1], second[2], second[3]);
+    // expect_for_pid: ("12 96 12 13 18 19")
+
+    // Even cores write ten tokens (k k k k) to a pipe that holds three of
+    // them, and odd cores read them while they are written
+    ebsp_stream pipe;
+    int pipe_tokens = 0;
+    int pipe_sum = 0;
+    bsp_stream_open(&pipe, 7 * bsp_nprocs() + 2 + s);
+    if (s % 2 == 0) {
+        // Alternate buffers, since the transfer of a token is only
+        // waited for when the next token is moved up
+        int out[2][4];
+        for (int k = 0; k < 10; ++k) {
+            for (int j = 0; j < 4; ++j)
+                out[k % 2][j] = k;
+            bsp_stream_move_up(&pipe, out[k % 2], sizeof(out[0]), 0);
+            pipe_tokens++;
+            pipe_sum += out[k % 2][0] + out[k % 2][3];
+        }
+    } else {
+        while (bsp_stream_move_down(&pipe, (void**)&tok, 1)) {
+            pipe_tokens++;
+            pipe_sum += tok[0] + tok[3];
+        }
+    }
+    bsp_stream_close(&pipe);
+    EBSP_MSG_ORDERED("%d %d", pipe_tokens, pipe_sum);
+    // expect_for_pid: ("10 90")
+
+    // Streams served by the host
+    if (s == 0) {
+        ebsp_stream source, sink;
+        bsp_stream_open(&source, 8 * bsp_nprocs() + 2);
+        bsp_stream_open(&sink, 8 * bsp_nprocs() + 4);
+        while (bsp_stream_move_down(&source, (void**)&tok, 1)) {
+            for (int j = 0; j < 4; ++j)
+                tok[j]++;
+            bsp_stream_move_up(&sink, tok, 4 * sizeof(int), 1);
+        }
+        bsp_stream_close(&source);
+        bsp_stream_close(&sink);
+    }
+
+    // Seek back in an indexed stream and move up more, smaller tokens
+    ebsp_stream ix;
+    bsp_stream_open(&ix, 8 * bsp_nprocs() + 6 + s);
+    bsp_stream_move_down(&ix, (void**)&tok, 0);
+    bsp_stream_seek_to(&ix, 0);
+    for (int t = 0; t < 6; t++) {
+        up1[0] = 10 + t;
+        up1[1] = s;
+        bsp_stream_move_up(&ix, up1, 2 * sizeof(int), 1);
+    }
+    bsp_stream_seek_to(&ix, 4);
+    bsp_stream_move_down(&ix, (void**)&tok, 0);
+    first[0] = tok[0];
+    bsp_stream_seek(&ix, -3);
+    bsp_stream_move_down(&ix, (void**)&tok, 0);
+    first[1] = tok[0];
+    first[2] = 0;
+    while (bsp_stream_move_down(&ix, (void**)&tok, 0))
+        first[2]++;
+    EBSP_MSG_ORDERED("%d %d %d", first[0], first[1], first[2]);
+    // expect_for_pid: ("14 11 4")
+    bsp_stream_close(&ix);
+
     bsp_stream_close(&s1);
     bsp_stream_close(&s2);
 
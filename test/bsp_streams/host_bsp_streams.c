@@ -24,6 +24,25 @@ see the files COPYING and COPYING.LESSER. If not, see
 #include <stdio.h>
 #include <stdlib.h>
 
+// Gives the tokens (t t t t) for t = 0, ..., 19
+int next_token = 0;
+int count_source(void* user_data, void* token, int max_size) {
+    if (next_token == 20)
+        return 0;
+    for (int j = 0; j < 4; ++j)
+        ((int*)token)[j] = next_token;
+    next_token++;
+    return 4 * sizeof(int);
+}
+
+// Counts the tokens and adds their first integers
+int sink_result[2];
+void sum_sink(void* user_data, const void* token, int size) {
+    int* result = (int*)user_data;
+    result[0]++;
+    result[1] += ((const int*)token)[0];
+}
+
 int main(int argc, char** argv) {
     bsp_init("e_bsp_streams.elf", argc, argv);
     bsp_begin(bsp_nprocs());
@@ -68,6 +87,77 @@ int main(int argc, char** argv) {
             bsp_stream_create(chunks * chunk_size, chunk_size, downdata);
     }
 
+    // And an indexed one, written by the core with tokens of different size
+    for (int s = 0; s < bsp_nprocs(); ++s)
+        bsp_stream_create_indexed(chunks * chunk_size, chunk_size, 0);
+
+    // Raw streams: one filled with 0 1 2 ... 13 in tokens of three integers,
+    // and an empty one that is used in place as a down stream afterwards
+    int rawdata[14];
+    for (int i = 0; i < 14; ++i)
+        rawdata[i] = i;
+    int** rawup = malloc(sizeof(int*) * bsp_nprocs());
+    for (int s = 0; s < bsp_nprocs(); ++s)
+        bsp_stream_create_raw(sizeof(rawdata), 3 * sizeof(int), rawdata);
+    for (int s = 0; s < bsp_nprocs(); ++s)
+        rawup[s] = bsp_stream_create_raw(sizeof(rawdata), 3 * sizeof(int), 0);
+
+    // A shared stream, read by all cores
+    bsp_stream_create_shared(chunks * chunk_size, chunk_size, downdata);
+
+    // A distributed stream of 40 tokens, where token t is (t t t t)
+    int workdata[160];
+    for (int i = 0; i < 160; ++i)
+        workdata[i] = i / 4;
+    bsp_stream_create_distributed(sizeof(workdata), chunk_size, workdata);
+
+    // Encoded streams, where core s uses encoding 1 + s % 3
+    int encdata[32];
+    for (int i = 0; i < 32; ++i)
+        encdata[i] = (i / 6) * 3 - 5;
+    ebsp_encoding encodings[] = {EBSP_ENCODING_DELTA_VARINT, EBSP_ENCODING_RLE,
+                                 EBSP_ENCODING_BITPACK};
+    for (int s = 0; s < bsp_nprocs(); ++s)
+        bsp_stream_create_encoded(sizeof(encdata), chunk_size, encdata,
+                                  encodings[s % 3]);
+
+    // Tiled streams of a 4 x 6 matrix with element (i, j) = 6i + j, in tiles
+    // of 2 x 2 that go column of tiles by column of tiles, stored twice
+    int matrix[24];
+    for (int i = 0; i < 24; ++i)
+        matrix[i] = i;
+    for (int s = 0; s < bsp_nprocs(); ++s)
+        bsp_stream_create_tiled(4, 6, sizeof(int), matrix, EBSP_ROW_MAJOR, 2,
+                                2, EBSP_COLUMN_MAJOR, 2);
+
+    // Pipes from core 2k to core 2k + 1, with room for three tokens
+    for (int k = 0; k < bsp_nprocs() / 2; ++k)
+        bsp_stream_create_pipe(3, chunk_size);
+
+    // A stream that is filled by the host while core 0 reads it, and one
+    // that is emptied by the host, both with fewer slots than tokens
+    bsp_stream_create_source(4, chunk_size, count_source, 0);
+    bsp_stream_create_sink(2, chunk_size, sum_sink, sink_result);
+
+    // Indexed streams with initial data, that are overwritten by the core
+    // with more tokens of a smaller size
+    for (int s = 0; s < bsp_nprocs(); ++s)
+        bsp_stream_create_indexed(chunks * chunk_size, chunk_size, downdata);
+
+    // Another distributed stream, read with single tokens and batches mixed
+    bsp_stream_create_distributed(sizeof(workdata), chunk_size, workdata);
+
+    // A distributed stream of 64 tokens, that is closed with preloaded tokens
+    int moredata[256];
+    for (int i = 0; i < 256; ++i)
+        moredata[i] = i / 4;
+    bsp_stream_create_distributed(sizeof(moredata), chunk_size, moredata);
+
+    // Streams with tokens of different size, moved up by the core from
+    // the buffers that the stream owns
+    for (int s = 0; s < bsp_nprocs(); ++s)
+        bsp_stream_create(1024, 64 * sizeof(int), 0);
+
     ebsp_spmd();
 
     // results of old API
@@ -111,10 +201,34 @@ int main(int argc, char** argv) {
     printf("\n");
     // expect: (30 28 26 24 22 20 18 16 14 12 10 8 6 4 2 0 )
 
+    // A reader follows the tokens that core 5 has moved up
+    ebsp_stream_reader reader;
+    bsp_stream_reader_open(&reader, streams1[5]);
+    int ntokens = 0;
+    int firsts = 0;
+    int* token;
+    while (bsp_stream_reader_wait(&reader, (void**)&token)) {
+        ntokens++;
+        firsts += token[0];
+    }
+    printf("%i %i\n", ntokens, firsts);
+    // expect: (4 36)
+
+    // Core 0 moved up every token of the source stream plus one
+    printf("%i %i\n", sink_result[0], sink_result[1]);
+    // expect: (20 210)
+
+    // The raw up stream is a plain array
+    for (int i = 0; i < 14; ++i)
+        printf("%i ", rawup[5][i]);
+    printf("\n");
+    // expect: (0 2 4 6 8 10 12 14 16 18 20 22 24 26 )
+
     // finalize
     bsp_end();
 
     free(upstreams);
+    free(rawup);
     free(downdata);
     free(downdataB);
 